@@ -6,7 +6,10 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* 이 파일의 코드는 ATA (IDE) 컨트롤러에 대한 인터페이스입니다. 
 	[ATA-3] 표준을 준수하려고 시도합니다. */
@@ -32,6 +35,7 @@
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -46,6 +50,41 @@
 #define CMD_IDENTIFY_DEVICE 0xec	/* 장치 식별 (IDENTIFY DEVICE). */
 #define CMD_READ_SECTOR_RETRY 0x20	/* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8			/* READ DMA. */
+#define CMD_WRITE_DMA 0xca			/* WRITE DMA. */
+
+/* 명령 하나로 옮길 수 있는 최대 섹터 수는 DISK_MULTI_MAX(256)이며,
+	Sector Count 레지스터에는 0으로 기록합니다. */
+
+/* 버스 마스터 IDE 레지스터 포트 주소 (PIIX 계열, 채널마다 8바이트). */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)	 /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)	 /* PRD Table Address. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start/Stop Bus Master. */
+#define BM_CMD_READ 0x08  /* 1=디스크에서 메모리로 (읽기). */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ERROR 0x02 /* Error (1을 써서 지움). */
+#define BM_STA_INTR 0x04  /* Interrupt (1을 써서 지움). */
+
+/* 물리 영역 기술자 (Physical Region Descriptor).
+	DMA로 옮길 물리 메모리 구간 하나를 나타내며, 64 kB 경계를 넘을 수 없습니다. */
+struct prd
+{
+	uint32_t addr;	/* 물리 주소. */
+	uint16_t size;	/* 바이트 수 (0이면 64 kB). */
+	uint16_t flags; /* PRD_EOT이면 테이블의 마지막 항목. */
+};
+#define PRD_EOT 0x8000
+
+/* PCI 설정 공간 접근 포트 (Configuration Mechanism #1). */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* true이면 가능한 경우 버스 마스터 DMA로 전송합니다 (커널 옵션 -dma). */
+bool disk_use_dma;
 
 /* An ATA device. */
 struct disk
@@ -55,10 +94,13 @@ struct disk
 	int dev_no;				 /* Device 0 or 1 for master or slave. */
 
 	bool is_ata;			/* 1=This device is an ATA disk. */
+	bool dma;				/* 1=This device accepts DMA commands. */
 	disk_sector_t capacity; /* Capacity in sectors (if is_ata). */
 
 	long long read_cnt;	 /* Number of sectors read. */
 	long long write_cnt; /* Number of sectors written. */
+
+	disk_sector_t head; /* 이 디스크에서 마지막으로 처리한 요청의 끝 섹터 (C-LOOK 기준). */
 };
 
 /* ATA 채널(컨트롤러).
@@ -74,9 +116,20 @@ struct channel
 										그렇지 않으면(예상치 못한 인터럽트면) false. */
 	struct semaphore completion_wait; /* 인터럽트 핸들러에 의해 up되는 세마포어. */
 
+	uint16_t bm_base;  /* 버스 마스터 IDE 포트 (0이면 PIO만 사용). */
+	struct prd *prdt;  /* 이 채널의 PRD 테이블 (페이지 하나). */
+
+	struct list queue;			  /* 처리를 기다리는 disk_request 목록. */
+	struct lock queue_lock;		  /* queue를 보호하는 락. */
+	struct condition queue_cond;  /* queue에 요청이 들어오면 signal. */
+	int last_dev;				  /* 마지막으로 처리한 요청의 디바이스 번호 (두 디스크를 번갈아 처리). */
+
 	struct disk devices[2]; /* 이 채널에 연결된 디바이스들. */
 };
 
+/* 디스패처가 인접한 요청을 한 명령으로 묶을 때의 최대 요청 수. */
+#define MERGE_MAX 16
+
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
@@ -85,7 +138,7 @@ static void reset_channel(struct channel *);
 static bool check_device_type(struct disk *);
 static void identify_ata_device(struct disk *);
 
-static void select_sector(struct disk *, disk_sector_t);
+static void select_sector(struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command(struct channel *, uint8_t command);
 static void input_sector(struct channel *, void *);
 static void output_sector(struct channel *, const void *);
@@ -95,12 +148,26 @@ static bool wait_while_busy(const struct disk *);
 static void select_device(const struct disk *);
 static void select_device_wait(const struct disk *);
 
+static uint16_t find_bus_master(void);
+static bool use_dma(struct disk_request **, size_t n);
+static bool dma_transfer(struct disk_request **, size_t n);
+static void pio_transfer(struct disk_request **, size_t n);
+static void disk_dispatcher(void *channel_);
+
 static void interrupt_handler(struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void disk_init(void)
 {
 	size_t chan_no;
+	uint16_t bm_base = 0;
+
+	if (disk_use_dma)
+	{
+		bm_base = find_bus_master();
+		if (bm_base == 0)
+			printf("disk: no bus-master IDE controller, using PIO\n");
+	}
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
 	{
@@ -125,6 +192,12 @@ void disk_init(void)
 		lock_init(&c->lock);
 		c->expecting_interrupt = false;
 		sema_init(&c->completion_wait, 0);
+		c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+		c->prdt = c->bm_base != 0 ? palloc_get_page(PAL_ASSERT | PAL_ZERO) : NULL;
+		list_init(&c->queue);
+		lock_init(&c->queue_lock);
+		cond_init(&c->queue_cond);
+		c->last_dev = 1;
 
 		/* Initialize devices. */
 		for (dev_no = 0; dev_no < 2; dev_no++)
@@ -135,9 +208,11 @@ void disk_init(void)
 			d->dev_no = dev_no;
 
 			d->is_ata = false;
+			d->dma = false;
 			d->capacity = 0;
 
 			d->read_cnt = d->write_cnt = 0;
+			d->head = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -154,6 +229,10 @@ void disk_init(void)
 		for (dev_no = 0; dev_no < 2; dev_no++)
 			if (c->devices[dev_no].is_ata)
 				identify_ata_device(&c->devices[dev_no]);
+
+		/* 이후의 읽기/쓰기는 채널별 디스패처 스레드가 처리합니다. */
+		if (c->devices[0].is_ata || c->devices[1].is_ata)
+			thread_create(c->name, PRI_MAX, disk_dispatcher, c);
 	}
 
 	/* DO NOT MODIFY BELOW LINES. */
@@ -216,21 +295,7 @@ disk_size(struct disk *d)
    내부적으로 디스크 접근을 동기화하므로, 별도의 디스크별 락은 필요하지 않습니다. */
    void disk_read(struct disk *d, disk_sector_t sec_no, void *buffer)
 {
-	struct channel *c;
-
-	ASSERT(d != NULL);
-	ASSERT(buffer != NULL);
-
-	c = d->channel;
-	lock_acquire(&c->lock);
-	select_sector(d, sec_no);
-	issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-	sema_down(&c->completion_wait);
-	if (!wait_while_busy(d))
-		PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-	input_sector(c, buffer);
-	d->read_cnt++;
-	lock_release(&c->lock);
+	disk_read_multi(d, sec_no, 1, buffer);
 }
 
 /* BUFFER에 있는 데이터를 디스크 D의 섹터 SEC_NO에 기록합니다.
@@ -238,22 +303,205 @@ disk_size(struct disk *d)
    디스크가 데이터를 받았음을 확인한 후 반환합니다.
    내부적으로 디스크 접근을 동기화하므로, 별도의 디스크별 락은 필요하지 않습니다. */
    void disk_write(struct disk *d, disk_sector_t sec_no, const void *buffer)
+{
+	disk_write_multi(d, sec_no, 1, buffer);
+}
+
+/* 디스크 D의 섹터 SEC_NO부터 연속된 CNT개의 섹터를 읽어 BUFFER에 저장합니다.
+   CNT는 1 이상 DISK_MULTI_MAX 이하여야 하며,
+   BUFFER는 CNT * DISK_SECTOR_SIZE 바이트만큼의 공간이 있어야 합니다.
+   요청을 채널 큐에 넣고 완료될 때까지 기다립니다. */
+void disk_read_multi(struct disk *d, disk_sector_t sec_no, size_t cnt, void *buffer)
+{
+	struct disk_request req;
+
+	disk_submit(&req, d, sec_no, cnt, buffer, false);
+	disk_wait(&req);
+}
+
+/* BUFFER에 있는 CNT개 섹터의 데이터를 디스크 D의 섹터 SEC_NO부터 기록합니다.
+   CNT는 1 이상 DISK_MULTI_MAX 이하여야 합니다.
+   디스크가 마지막 섹터까지 받았음을 확인한 후 반환합니다. */
+void disk_write_multi(struct disk *d, disk_sector_t sec_no, size_t cnt, const void *buffer)
+{
+	struct disk_request req;
+
+	disk_submit(&req, d, sec_no, cnt, (void *)buffer, true);
+	disk_wait(&req);
+}
+
+/* 디스크 D의 SEC_NO부터 CNT개 섹터를 BUFFER와 주고받는 요청 REQ를 채널 큐에 넣고
+   바로 반환합니다. WRITE가 true이면 쓰기, 아니면 읽기입니다.
+   완료는 disk_wait()로 기다리며, 그때까지 REQ와 BUFFER는 유효해야 합니다. */
+void disk_submit(struct disk_request *req, struct disk *d, disk_sector_t sec_no,
+				 size_t cnt, void *buffer, bool write)
 {
 	struct channel *c;
 
 	ASSERT(d != NULL);
 	ASSERT(buffer != NULL);
+	ASSERT(cnt >= 1 && cnt <= DISK_MULTI_MAX);
+	ASSERT(sec_no < d->capacity && cnt <= d->capacity - sec_no);
+
+	req->disk = d;
+	req->sec_no = sec_no;
+	req->cnt = cnt;
+	req->buffer = buffer;
+	req->write = write;
+	sema_init(&req->done, 0);
 
 	c = d->channel;
-	lock_acquire(&c->lock);
-	select_sector(d, sec_no);
-	issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy(d))
-		PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-	output_sector(c, buffer);
-	sema_down(&c->completion_wait);
-	d->write_cnt++;
-	lock_release(&c->lock);
+	lock_acquire(&c->queue_lock);
+	list_push_back(&c->queue, &req->elem);
+	cond_signal(&c->queue_cond, &c->queue_lock);
+	lock_release(&c->queue_lock);
+}
+
+/* disk_submit()으로 넣은 요청 REQ가 끝날 때까지 기다립니다. */
+void disk_wait(struct disk_request *req)
+{
+	sema_down(&req->done);
+}
+
+/* 채널 C의 큐에서 다음 요청을 고르고, 그 뒤에 섹터가 바로 이어지는
+   같은 디스크, 같은 방향의 요청들을 REQS에 덧붙여 꺼냅니다. 꺼낸 요청 수를 반환합니다.
+   두 디스크에 모두 요청이 있으면 직전에 처리하지 않은 디스크를 고르고,
+   그 디스크 안에서는 C-LOOK 순서를 따릅니다: 그 디스크의 헤드 위치 이상에서
+   가장 가까운 요청을 고르고, 없으면 가장 낮은 섹터로 돌아갑니다. */
+static size_t
+dequeue_batch(struct channel *c, struct disk_request **reqs)
+{
+	struct disk_request *next = NULL, *lowest = NULL;
+	struct list_elem *e;
+	struct disk *d = NULL;
+
+	ASSERT(lock_held_by_current_thread(&c->queue_lock));
+	ASSERT(!list_empty(&c->queue));
+
+	/* 직전에 처리하지 않은 디스크의 요청이 하나라도 있으면 그 디스크를 고른다. */
+	for (e = list_begin(&c->queue); e != list_end(&c->queue); e = list_next(e))
+	{
+		struct disk_request *r = list_entry(e, struct disk_request, elem);
+		if (d == NULL || r->disk->dev_no != c->last_dev)
+			d = r->disk;
+		if (d->dev_no != c->last_dev)
+			break;
+	}
+
+	for (e = list_begin(&c->queue); e != list_end(&c->queue); e = list_next(e))
+	{
+		struct disk_request *r = list_entry(e, struct disk_request, elem);
+		if (r->disk != d)
+			continue;
+		if (lowest == NULL || r->sec_no < lowest->sec_no)
+			lowest = r;
+		if (r->sec_no >= d->head && (next == NULL || r->sec_no < next->sec_no))
+			next = r;
+	}
+	if (next == NULL)
+		next = lowest;
+	list_remove(&next->elem);
+	reqs[0] = next;
+
+	size_t n = 1;
+	size_t cnt = next->cnt;
+	disk_sector_t end = next->sec_no + next->cnt;
+	while (n < MERGE_MAX)
+	{
+		struct disk_request *adj = NULL;
+		for (e = list_begin(&c->queue); e != list_end(&c->queue); e = list_next(e))
+		{
+			struct disk_request *r = list_entry(e, struct disk_request, elem);
+			if (r->disk == next->disk && r->write == next->write && r->sec_no == end && cnt + r->cnt <= DISK_MULTI_MAX)
+			{
+				adj = r;
+				break;
+			}
+		}
+		if (adj == NULL)
+			break;
+		list_remove(&adj->elem);
+		reqs[n++] = adj;
+		cnt += adj->cnt;
+		end += adj->cnt;
+	}
+	d->head = end;
+	c->last_dev = d->dev_no;
+	return n;
+}
+
+/* 채널마다 하나씩 도는 디스패처 스레드.
+   큐에서 요청 묶음을 꺼내 명령 하나로 처리하고, 기다리는 스레드들을 깨웁니다. */
+static void
+disk_dispatcher(void *channel_)
+{
+	struct channel *c = channel_;
+	struct disk_request *reqs[MERGE_MAX];
+
+	for (;;)
+	{
+		lock_acquire(&c->queue_lock);
+		while (list_empty(&c->queue))
+			cond_wait(&c->queue_cond, &c->queue_lock);
+		size_t n = dequeue_batch(c, reqs);
+		lock_release(&c->queue_lock);
+
+		struct disk *d = reqs[0]->disk;
+		size_t cnt = 0;
+		for (size_t i = 0; i < n; i++)
+			cnt += reqs[i]->cnt;
+
+		lock_acquire(&c->lock);
+		if (!use_dma(reqs, n) || !dma_transfer(reqs, n))
+			pio_transfer(reqs, n);
+		if (reqs[0]->write)
+			d->write_cnt += cnt;
+		else
+			d->read_cnt += cnt;
+		lock_release(&c->lock);
+
+		for (size_t i = 0; i < n; i++)
+			sema_up(&reqs[i]->done);
+	}
+}
+
+/* 섹터가 이어지는 요청 REQS[0..N)을 READ/WRITE SECTOR 명령 하나로 PIO 전송합니다.
+   디스크는 섹터마다 인터럽트를 올리므로 그때마다 한 섹터씩 각 요청의 버퍼와 주고받습니다. */
+static void
+pio_transfer(struct disk_request **reqs, size_t n)
+{
+	struct disk *d = reqs[0]->disk;
+	struct channel *c = d->channel;
+	bool write = reqs[0]->write;
+	disk_sector_t sec_no = reqs[0]->sec_no;
+	size_t cnt = 0;
+
+	for (size_t i = 0; i < n; i++)
+		cnt += reqs[i]->cnt;
+
+	select_sector(d, sec_no, cnt);
+	issue_pio_command(c, write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint8_t *p = reqs[i]->buffer;
+		for (size_t j = 0; j < reqs[i]->cnt; j++, p += DISK_SECTOR_SIZE, sec_no++)
+		{
+			if (write)
+			{
+				if (!wait_while_busy(d))
+					PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
+				output_sector(c, p);
+				sema_down(&c->completion_wait);
+			}
+			else
+			{
+				sema_down(&c->completion_wait);
+				if (!wait_while_busy(d))
+					PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
+				input_sector(c, p);
+			}
+		}
+	}
 }
 
 /* 디스크 감지 및 식별. */
@@ -376,6 +624,9 @@ identify_ata_device(struct disk *d)
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t)id[61] << 16);
 
+	/* Word 49 bit 8: DMA supported. */
+	d->dma = (id[49] & 0x0100) != 0;
+
 	/* Print identification message. */
 	printf("%s: detected %'" PRDSNu " sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -416,17 +667,18 @@ print_ata_string(char *string, size_t size)
 }
 
 /* 디바이스 D를 선택하고, 준비될 때까지 기다린 다음,
-   SEC_NO를 디스크의 섹터 선택 레지스터에 기록합니다. (LBA 모드를 사용함) */
+   SEC_NO와 섹터 수 CNT를 디스크의 섹터 선택 레지스터에 기록합니다. (LBA 모드를 사용함) */
 static void
-select_sector(struct disk *d, disk_sector_t sec_no)
+select_sector(struct disk *d, disk_sector_t sec_no, size_t cnt)
 {
 	struct channel *c = d->channel;
 
-	ASSERT(sec_no < d->capacity);
-	ASSERT(sec_no < (1UL << 28));
+	ASSERT(cnt >= 1 && cnt <= DISK_MULTI_MAX);
+	ASSERT(sec_no < d->capacity && cnt <= d->capacity - sec_no);
+	ASSERT(sec_no + cnt <= (1UL << 28));
 
 	select_device_wait(d);
-	outb(reg_nsect(c), 1);
+	outb(reg_nsect(c), cnt == DISK_MULTI_MAX ? 0 : cnt);
 	outb(reg_lbal(c), sec_no);
 	outb(reg_lbam(c), sec_no >> 8);
 	outb(reg_lbah(c), (sec_no >> 16));
@@ -461,6 +713,141 @@ output_sector(struct channel *c, const void *sector)
 	outsw(reg_data(c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* 버스 마스터 DMA. */
+
+/* PCI 버스 BUS, 장치 DEV, 기능 FUNC의 설정 레지스터 REG를 읽습니다. */
+static uint32_t
+pci_read_config(int bus, int dev, int func, int reg)
+{
+	outl(PCI_CONFIG_ADDR, 0x80000000 | bus << 16 | dev << 11 | func << 8 | (reg & 0xfc));
+	return inl(PCI_CONFIG_DATA);
+}
+
+/* PCI 버스 BUS, 장치 DEV, 기능 FUNC의 설정 레지스터 REG에 VALUE를 씁니다. */
+static void
+pci_write_config(int bus, int dev, int func, int reg, uint32_t value)
+{
+	outl(PCI_CONFIG_ADDR, 0x80000000 | bus << 16 | dev << 11 | func << 8 | (reg & 0xfc));
+	outl(PCI_CONFIG_DATA, value);
+}
+
+/* PCI 버스 0에서 버스 마스터를 지원하는 IDE 컨트롤러(QEMU의 PIIX3 등)를 찾아
+   버스 마스터를 켜고, BAR4의 I/O 포트 주소를 반환합니다. 없으면 0을 반환합니다. */
+static uint16_t
+find_bus_master(void)
+{
+	for (int dev = 0; dev < 32; dev++)
+		for (int func = 0; func < 8; func++)
+		{
+			if ((pci_read_config(0, dev, func, 0x00) & 0xffff) == 0xffff)
+				continue;
+
+			/* Class 0x01 (mass storage), subclass 0x01 (IDE), prog-if bit 7 (bus master). */
+			uint32_t class = pci_read_config(0, dev, func, 0x08);
+			if ((class >> 24) != 0x01 || ((class >> 16) & 0xff) != 0x01 || !(class & 0x8000))
+				continue;
+
+			uint32_t bar4 = pci_read_config(0, dev, func, 0x20);
+			if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+				continue;
+
+			/* Command 레지스터: I/O 공간 접근(bit 0)과 버스 마스터(bit 2)를 켭니다. */
+			uint32_t command = pci_read_config(0, dev, func, 0x04) & 0xffff;
+			pci_write_config(0, dev, func, 0x04, command | 0x05);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
+/* 요청 REQS[0..N)을 DMA로 옮길 수 있으면 true를 반환합니다.
+   버스 마스터는 물리 주소를 쓰므로 각 버퍼는 커널 주소여야 하고
+   (커널 영역은 물리 메모리를 그대로 매핑하므로 연속입니다), 4 GB 아래에 있어야 합니다. */
+static bool
+use_dma(struct disk_request **reqs, size_t n)
+{
+	const struct disk *d = reqs[0]->disk;
+
+	if (d->channel->bm_base == 0 || !d->dma)
+		return false;
+	for (size_t i = 0; i < n; i++)
+	{
+		const void *buffer = reqs[i]->buffer;
+		if (!is_kernel_vaddr(buffer) || ((uintptr_t)buffer & 1))
+			return false;
+		if (vtop(buffer) + reqs[i]->cnt * DISK_SECTOR_SIZE > 0x100000000ULL)
+			return false;
+	}
+	return true;
+}
+
+/* 채널 C의 PRD 테이블에 요청 REQS[0..N)의 버퍼를 차례로 기술합니다 (scatter-gather).
+   한 항목은 64 kB 경계를 넘을 수 없으므로 경계마다 나눕니다. */
+static void
+build_prdt(struct channel *c, struct disk_request **reqs, size_t n)
+{
+	struct prd *p = c->prdt;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t addr = vtop(reqs[i]->buffer);
+		size_t size = reqs[i]->cnt * DISK_SECTOR_SIZE;
+
+		while (size > 0)
+		{
+			size_t chunk = 0x10000 - (addr & 0xffff);
+			if (chunk > size)
+				chunk = size;
+			p->addr = addr;
+			p->size = chunk & 0xffff;
+			p->flags = 0;
+			addr += chunk;
+			size -= chunk;
+			p++;
+		}
+	}
+	p[-1].flags = PRD_EOT;
+}
+
+/* 채널 락을 쥔 상태에서 섹터가 이어지는 요청 REQS[0..N)을 DMA 명령 하나로 옮깁니다.
+   완료는 기존 interrupt_handler가 completion_wait을 올려 알려 줍니다.
+   실패하면 이 디스크의 DMA를 끄고 false를 반환하며, 호출자는 PIO로 다시 시도합니다. */
+static bool
+dma_transfer(struct disk_request **reqs, size_t n)
+{
+	struct disk *d = reqs[0]->disk;
+	struct channel *c = d->channel;
+	bool write = reqs[0]->write;
+	uint8_t direction = write ? 0 : BM_CMD_READ;
+	size_t cnt = 0;
+
+	ASSERT(lock_held_by_current_thread(&c->lock));
+
+	for (size_t i = 0; i < n; i++)
+		cnt += reqs[i]->cnt;
+
+	build_prdt(c, reqs, n);
+	outl(reg_bm_prdt(c), vtop(c->prdt));
+	outb(reg_bm_command(c), direction);
+	outb(reg_bm_status(c), inb(reg_bm_status(c)) | BM_STA_ERROR | BM_STA_INTR);
+
+	select_sector(d, reqs[0]->sec_no, cnt);
+	issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb(reg_bm_command(c), direction | BM_CMD_START);
+	sema_down(&c->completion_wait);
+	outb(reg_bm_command(c), direction);
+
+	uint8_t bm_status = inb(reg_bm_status(c));
+	outb(reg_bm_status(c), bm_status | BM_STA_ERROR | BM_STA_INTR);
+	if ((bm_status & BM_STA_ERROR) || (inb(reg_alt_status(c)) & STA_ERR))
+	{
+		printf("%s: DMA %s failed at sector %" PRDSNu ", falling back to PIO\n",
+			   d->name, write ? "write" : "read", reqs[0]->sec_no);
+		d->dma = false;
+		return false;
+	}
+	return true;
+}
+
 /* 저수준 ATA 기본 연산들. */
 
 /* 컨트롤러가 유휴 상태가 될 때까지(즉, 상태 레지스터의 BSY와 DRQ 비트가 해제될 때까지) 최대 10초 동안 대기합니다.
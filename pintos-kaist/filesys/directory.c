@@ -2,11 +2,302 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* 엔트리 수가 이만큼을 넘으려 하면 디렉터리를 해시 색인 형식으로 바꾼다.
+ * 그보다 작은 디렉터리는 예전처럼 엔트리 배열을 선형 탐색한다. */
+#define DIR_INDEX_THRESHOLD 64
+
+/* 색인 형식에서 버킷 하나에 들어가는 엔트리 수와 크기.
+ * 버킷 하나는 섹터 하나를 꽉 채우고, 엔트리 뒤 남는 바이트는 비워 둔다.
+ * 그래서 버킷이 섹터 경계에 걸치지 않고 조회와 나누기가 섹터 하나씩만 건드린다. */
+#define DIR_BUCKET_ENTRIES (DISK_SECTOR_SIZE / sizeof(struct dir_entry))
+#define DIR_BUCKET_SIZE DISK_SECTOR_SIZE
+#define DIR_BUCKET_USED (DIR_BUCKET_ENTRIES * sizeof(struct dir_entry))
+
+/* 색인 디렉터리 앞머리의 버킷 표. 항목 수는 버킷 수의 상한이기도 하다. */
+#define DIR_TABLE_BITS 10
+#define DIR_TABLE_ENTRIES (1 << DIR_TABLE_BITS)
+#define DIR_TABLE_SIZE (DIR_TABLE_ENTRIES * sizeof(uint16_t))
+
+/* 선형 디렉터리를 바꿀 때 메모리에서 만들어 보는 버킷 수의 상한. */
+#define DIR_CONVERT_BUCKETS 8
+
+/* 색인 형식 디렉터리는 앞의 DIR_TABLE_SIZE 바이트에 버킷 표를 두고 그 뒤에 버킷을 잇는다.
+ * 이름 해시의 상위 DIR_TABLE_BITS 비트가 표 항목을 고르고, 항목에는 그 이름이 들어갈 버킷 번호가 있다.
+ * 한 버킷은 해시 상위 비트가 같은 이름들을 맡으므로 그 버킷을 가리키는 항목은 표에서 연속이다.
+ * 버킷이 차면 그 버킷만 나눈다. 새 버킷 하나를 파일 끝에 붙이고 맡은 항목 구간의 뒤쪽 절반이
+ * 새 버킷을 가리키게 하므로, 나누기 한 번이 쓰는 양은 버킷 둘과 표 일부로 정해져 있다.
+ * dir_readdir()는 표를 건너뛰고 엔트리를 차례로 읽되, 버킷 끝의 여백은 skip_padding()으로 넘는다. */
+
+/* 색인 디렉터리 DIR의 버킷 수. */
+static size_t
+bucket_count(const struct dir *dir)
+{
+	return (inode_length(dir->inode) - DIR_TABLE_SIZE) / DIR_BUCKET_SIZE;
+}
+
+/* 버킷 B의 바이트 오프셋. */
+static off_t
+bucket_ofs(size_t b)
+{
+	return DIR_TABLE_SIZE + b * DIR_BUCKET_SIZE;
+}
+
+/* 버킷 B개를 잇달아 담은 메모리 BASE에서 버킷 B의 엔트리 배열. */
+static struct dir_entry *
+bucket_at(void *base, size_t b)
+{
+	return (struct dir_entry *)((uint8_t *)base + b * DIR_BUCKET_SIZE);
+}
+
+/* NAME이 고르는 버킷 표 항목. */
+static size_t
+name_slot(const char *name)
+{
+	return hash_string(name) >> (64 - DIR_TABLE_BITS);
+}
+
+/* 색인 디렉터리 DIR에서 NAME이 들어갈 버킷의 오프셋. 표를 읽지 못하면 -1을 반환한다. */
+static off_t
+name_bucket(const struct dir *dir, const char *name)
+{
+	uint16_t b;
+
+	if (inode_read_at(dir->inode, &b, sizeof b, name_slot(name) * sizeof b) != sizeof b)
+		return -1;
+	return bucket_ofs(b);
+}
+
+/* DIR의 엔트리 배열이 시작하는 오프셋. 색인 디렉터리는 버킷 표 뒤부터다. */
+static off_t
+entries_start(const struct dir *dir)
+{
+	return inode_is_indexed(dir->inode) ? (off_t)DIR_TABLE_SIZE : 0;
+}
+
+/* DIR을 차례로 읽는 위치 POS가 엔트리 배열 앞이면 처음으로, 색인 디렉터리 버킷 끝의
+ * 여백이면 다음 버킷의 처음으로 옮긴다. 그 버킷에 남은 엔트리 수를 *LEFTP에 저장한다. */
+static off_t
+skip_padding(const struct dir *dir, off_t pos, size_t *leftp)
+{
+	*leftp = SIZE_MAX;
+	if (pos < entries_start(dir))
+		pos = entries_start(dir);
+	if (inode_is_indexed(dir->inode))
+	{
+		off_t in = (pos - DIR_TABLE_SIZE) % DIR_BUCKET_SIZE;
+		if (in >= (off_t)DIR_BUCKET_USED)
+		{
+			pos += DIR_BUCKET_SIZE - in;
+			in = 0;
+		}
+		*leftp = (DIR_BUCKET_USED - in) / sizeof(struct dir_entry);
+	}
+	return pos;
+}
+
+/* DIR의 OFS부터 엔트리 최대 CNT개를 버킷 단위로 읽으며 NAME을 찾는다.
+ * 찾으면 true를 반환하고 EP, OFSP가 NULL이 아니면 엔트리와 오프셋을 저장한다.
+ * FREEP가 NULL이 아니면 지나온 첫 빈 슬롯의 오프셋을 저장한다 (없으면 -1). */
+static bool
+scan(const struct dir *dir, off_t ofs, size_t cnt, const char *name,
+	 struct dir_entry *ep, off_t *ofsp, off_t *freep)
+{
+	struct dir_entry entries[DIR_BUCKET_ENTRIES];
+
+	if (freep != NULL)
+		*freep = -1;
+	if (ofs < 0)
+		return false;
+	while (cnt > 0)
+	{
+		size_t n = cnt < DIR_BUCKET_ENTRIES ? cnt : DIR_BUCKET_ENTRIES;
+		n = inode_read_at(dir->inode, entries, n * sizeof entries[0], ofs) / sizeof entries[0];
+		if (n == 0)
+			break;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			off_t e_ofs = ofs + i * sizeof entries[0];
+			if (!entries[i].in_use)
+			{
+				if (freep != NULL && *freep < 0)
+					*freep = e_ofs;
+			}
+			else if (!strcmp(name, entries[i].name))
+			{
+				if (ep != NULL)
+					*ep = entries[i];
+				if (ofsp != NULL)
+					*ofsp = e_ofs;
+				return true;
+			}
+		}
+		ofs += n * sizeof entries[0];
+		cnt -= n;
+	}
+	return false;
+}
+
+/* 버킷 표 TABLE에서 SLOT과 같은 버킷을 가리키는 항목 구간 [*LO, *HI)를 구한다. */
+static void
+table_range(const uint16_t *table, size_t slot, size_t *lo, size_t *hi)
+{
+	*lo = *hi = slot;
+	while (*lo > 0 && table[*lo - 1] == table[slot])
+		(*lo)--;
+	while (*hi < DIR_TABLE_ENTRIES && table[*hi] == table[slot])
+		(*hi)++;
+}
+
+/* 버킷 OLD의 엔트리를 맡은 항목 구간의 중간 MID를 기준으로 LO와 HI에 나누어 담는다.
+ * LO와 HI는 0으로 채워져 있어야 한다. */
+static void
+split_entries(const struct dir_entry *old, size_t mid,
+			  struct dir_entry *lo, struct dir_entry *hi)
+{
+	size_t lo_cnt = 0, hi_cnt = 0;
+
+	for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+		if (old[i].in_use)
+		{
+			if (name_slot(old[i].name) >= mid)
+				hi[hi_cnt++] = old[i];
+			else
+				lo[lo_cnt++] = old[i];
+		}
+}
+
+/* 선형 형식 디렉터리 DIR을 색인 형식으로 바꾼다.
+ * 버킷 표와 버킷을 메모리에서 만들되 dir_split()과 같은 방식으로 찬 버킷만 나누고,
+ * 파일을 먼저 늘린 뒤 한 번에 덮어쓴다. 늘어난 부분은 빈 슬롯으로 읽히므로
+ * 도중에 실패해도 디렉터리는 선형 형식 그대로 남는다. */
+static bool
+dir_make_indexed(struct dir *dir)
+{
+	size_t slot_cnt = inode_length(dir->inode) / sizeof(struct dir_entry);
+	size_t bucket_cnt = 1;
+	struct dir_entry *old;
+	uint16_t *table;
+	uint8_t *image, *buckets;
+	bool success = false;
+
+	old = malloc(slot_cnt * sizeof *old);
+	image = calloc(1, DIR_TABLE_SIZE + (DIR_CONVERT_BUCKETS + 1) * DIR_BUCKET_SIZE);
+	if (old == NULL || image == NULL)
+		goto done;
+	if (inode_read_at(dir->inode, old, slot_cnt * sizeof *old, 0) != (off_t)(slot_cnt * sizeof *old))
+		goto done;
+
+	/* 버킷 하나에서 시작해 엔트리를 넣다가 찬 버킷을 나눈다.
+	 * 마지막 버킷 뒤 한 칸은 나눌 때 쓰는 작업 공간이다. */
+	table = (uint16_t *)image;
+	buckets = image + DIR_TABLE_SIZE;
+	for (size_t i = 0; i < slot_cnt; i++)
+	{
+		if (!old[i].in_use)
+			continue;
+		for (;;)
+		{
+			size_t slot = name_slot(old[i].name);
+			struct dir_entry *bucket = bucket_at(buckets, table[slot]);
+			size_t j;
+			for (j = 0; j < DIR_BUCKET_ENTRIES && bucket[j].in_use; j++)
+				continue;
+			if (j < DIR_BUCKET_ENTRIES)
+			{
+				bucket[j] = old[i];
+				break;
+			}
+
+			size_t lo, hi;
+			table_range(table, slot, &lo, &hi);
+			if (hi - lo < 2 || bucket_cnt == DIR_CONVERT_BUCKETS)
+				goto done;
+			struct dir_entry *tmp = bucket_at(buckets, DIR_CONVERT_BUCKETS);
+			struct dir_entry *added = bucket_at(buckets, bucket_cnt);
+			memcpy(tmp, bucket, DIR_BUCKET_SIZE);
+			memset(bucket, 0, DIR_BUCKET_SIZE);
+			split_entries(tmp, (lo + hi) / 2, bucket, added);
+			for (size_t k = (lo + hi) / 2; k < hi; k++)
+				table[k] = bucket_cnt;
+			bucket_cnt++;
+		}
+	}
+
+	off_t size = bucket_ofs(bucket_cnt);
+	if (!journal_extend(inode_write_credits(dir->inode, 0, size) + inode_write_credits(dir->inode, size, 0)))
+		goto done;
+	if (!inode_grow(dir->inode, size)
+		|| inode_write_at(dir->inode, image, size, 0) != size)
+		goto done;
+	inode_set_indexed(dir->inode);
+	success = true;
+
+done:
+	free(image);
+	free(old);
+	return success;
+}
+
+/* 색인 디렉터리 DIR에서 NAME이 들어갈 버킷을 둘로 나눈다.
+ * 새 버킷을 파일 끝에 먼저 써 두고, 옛 버킷과 표의 항목 구간 뒤쪽 절반을 고친다.
+ * 새 버킷을 붙이지 못하면 아직 아무 항목도 그 버킷을 가리키지 않으므로 그대로다.
+ * 버킷 수가 표 크기에 이르렀거나 해시 상위 비트가 모두 같은 이름으로 찼다면 실패한다. */
+static bool
+dir_split(struct dir *dir, const char *name)
+{
+	size_t bucket_cnt = bucket_count(dir);
+	struct dir_entry *old, *lo, *hi;
+	uint16_t *table;
+	bool success = false;
+
+	if (bucket_cnt >= DIR_TABLE_ENTRIES)
+		return false;
+	table = malloc(DIR_TABLE_SIZE);
+	old = malloc(3 * DIR_BUCKET_SIZE);
+	if (table == NULL || old == NULL)
+		goto done;
+	lo = bucket_at(old, 1);
+	hi = bucket_at(old, 2);
+
+	size_t slot = name_slot(name), first, last;
+	if (inode_read_at(dir->inode, table, DIR_TABLE_SIZE, 0) != DIR_TABLE_SIZE)
+		goto done;
+	table_range(table, slot, &first, &last);
+	if (last - first < 2)
+		goto done;
+	size_t b = table[slot], mid = (first + last) / 2;
+	if (inode_read_at(dir->inode, old, DIR_BUCKET_SIZE, bucket_ofs(b)) != DIR_BUCKET_SIZE)
+		goto done;
+	memset(lo, 0, 2 * DIR_BUCKET_SIZE);
+	split_entries(old, mid, lo, hi);
+	for (size_t k = mid; k < last; k++)
+		table[k] = bucket_cnt;
+
+	off_t table_ofs = mid * sizeof *table, table_size = (last - mid) * sizeof *table;
+	size_t credits = inode_write_credits(dir->inode, DIR_BUCKET_SIZE, bucket_ofs(bucket_cnt))
+					 + inode_write_credits(dir->inode, DIR_BUCKET_SIZE, bucket_ofs(b))
+					 + inode_write_credits(dir->inode, table_size, table_ofs);
+	if (!journal_extend(credits))
+		goto done;
+	if (inode_write_at(dir->inode, hi, DIR_BUCKET_SIZE, bucket_ofs(bucket_cnt)) != DIR_BUCKET_SIZE
+		|| inode_write_at(dir->inode, lo, DIR_BUCKET_SIZE, bucket_ofs(b)) != DIR_BUCKET_SIZE
+		|| inode_write_at(dir->inode, (uint8_t *)table + table_ofs, table_size, table_ofs) != table_size)
+		goto done;
+	success = true;
 
-/* 하나의 디렉터리 엔트리. */
+done:
+	free(table);
+	free(old);
+	return success;
+}
 
 void dump_dir(struct dir *dir)
 {
@@ -27,10 +318,140 @@ void dump_dir(struct dir *dir)
 #endif
 }
 
+/* 경로 탐색 캐시(dentry 캐시)에 둘 최대 항목 수. */
+#define DENTRY_CACHE_SIZE 256
+
+/* (부모 디렉터리 섹터, 이름) -> 자식 inode 섹터 대응 하나.
+ * 없는 이름도 음성(negative) 항목으로 기억해 같은 실패를 반복하지 않는다. */
+struct dentry
+{
+	struct hash_elem elem;		/* dentry_cache의 원소. */
+	struct list_elem lru_elem;	/* dentry_lru의 원소. */
+	disk_sector_t parent;		/* 부모 디렉터리의 inode 섹터. */
+	char name[NAME_MAX + 1];	/* 엔트리 이름. */
+	bool negative;				/* 이름이 없다는 사실을 기억하는 항목이면 true. */
+	disk_sector_t sector;		/* 자식 inode 섹터 (negative이면 무의미). */
+};
+
+static struct hash dentry_cache;
+static struct list dentry_lru; /* 앞쪽이 가장 최근에 쓴 항목. */
+static size_t dentry_cnt;
+static struct lock dentry_lock;
+
+static uint64_t
+dentry_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct dentry *d = hash_entry(e, struct dentry, elem);
+	return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+static bool
+dentry_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED)
+{
+	const struct dentry *a = hash_entry(a_, struct dentry, elem);
+	const struct dentry *b = hash_entry(b_, struct dentry, elem);
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp(a->name, b->name) < 0;
+}
+
+/* dentry 캐시를 초기화한다. */
+void dir_cache_init(void)
+{
+	hash_init(&dentry_cache, dentry_hash, dentry_less, NULL);
+	list_init(&dentry_lru);
+	lock_init(&dentry_lock);
+}
+
+/* (PARENT, NAME) 항목을 찾는다. dentry_lock을 잡고 호출해야 한다. */
+static struct dentry *
+dentry_find(disk_sector_t parent, const char *name)
+{
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.parent = parent;
+	strlcpy(key.name, name, sizeof key.name);
+	e = hash_find(&dentry_cache, &key.elem);
+	return e != NULL ? hash_entry(e, struct dentry, elem) : NULL;
+}
+
+/* 항목 D를 캐시에서 빼고 해제한다. dentry_lock을 잡고 호출해야 한다. */
+static void
+dentry_drop(struct dentry *d)
+{
+	hash_delete(&dentry_cache, &d->elem);
+	list_remove(&d->lru_elem);
+	dentry_cnt--;
+	free(d);
+}
+
+/* (PARENT, NAME)의 조회 결과를 캐시에 기록한다.
+ * 가득 찼으면 가장 오래 쓰이지 않은 항목을 버린다. */
+static void
+dentry_insert(disk_sector_t parent, const char *name, bool negative, disk_sector_t sector)
+{
+	struct dentry *d;
+
+	lock_acquire(&dentry_lock);
+	d = dentry_find(parent, name);
+	if (d == NULL)
+	{
+		if (dentry_cnt >= DENTRY_CACHE_SIZE)
+			dentry_drop(list_entry(list_back(&dentry_lru), struct dentry, lru_elem));
+		d = malloc(sizeof *d);
+		if (d == NULL)
+			goto done;
+		d->parent = parent;
+		strlcpy(d->name, name, sizeof d->name);
+		hash_insert(&dentry_cache, &d->elem);
+		dentry_cnt++;
+	}
+	else
+		list_remove(&d->lru_elem);
+	list_push_front(&dentry_lru, &d->lru_elem);
+	d->negative = negative;
+	d->sector = sector;
+done:
+	lock_release(&dentry_lock);
+}
+
+/* (PARENT, NAME) 항목을 무효화한다. */
+static void
+dentry_invalidate(disk_sector_t parent, const char *name)
+{
+	struct dentry *d;
+
+	lock_acquire(&dentry_lock);
+	d = dentry_find(parent, name);
+	if (d != NULL)
+		dentry_drop(d);
+	lock_release(&dentry_lock);
+}
+
+/* 부모가 PARENT인 항목을 모두 버린다.
+ * 지워진 디렉터리의 섹터가 새 디렉터리에 재사용될 때 부른다. */
+static void
+dentry_invalidate_dir(disk_sector_t parent)
+{
+	struct list_elem *e;
+
+	lock_acquire(&dentry_lock);
+	for (e = list_begin(&dentry_lru); e != list_end(&dentry_lru);)
+	{
+		struct dentry *d = list_entry(e, struct dentry, lru_elem);
+		e = list_next(e);
+		if (d->parent == parent)
+			dentry_drop(d);
+	}
+	lock_release(&dentry_lock);
+}
+
 /* 주어진 SECTOR에 ENTRY_CNT개의 엔트리를 저장할 공간을 갖는
  * 디렉터리를 생성합니다. 성공하면 true, 실패하면 false를 반환합니다. */
 bool dir_create(disk_sector_t sector, size_t entry_cnt)
 {
+	dentry_invalidate_dir(sector);
 	return inode_create(sector, entry_cnt * sizeof(struct dir_entry), true);
 }
 
@@ -39,7 +460,7 @@ bool dir_create(disk_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open(struct inode *inode)
 {
-	struct dir *dir = calloc(1, sizeof(struct dir *));
+	struct dir *dir = calloc(1, sizeof(struct dir));
 	if (inode != NULL && dir != NULL)
 	{
 		dir->inode = inode;
@@ -95,23 +516,13 @@ static bool
 lookup(const struct dir *dir, const char *name,
 	   struct dir_entry *ep, off_t *ofsp)
 {
-	struct dir_entry e;
-	size_t ofs;
-
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
 
-	for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-		 ofs += sizeof e)
-		if (e.in_use && !strcmp(name, e.name))
-		{
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
-		}
-	return false;
+	/* 색인 디렉터리는 NAME의 버킷 하나만 보면 된다. */
+	if (inode_is_indexed(dir->inode))
+		return scan(dir, name_bucket(dir, name), DIR_BUCKET_ENTRIES, name, ep, ofsp, NULL);
+	return scan(dir, 0, SIZE_MAX, name, ep, ofsp, NULL);
 }
 
 /* DIR에서 주어진 NAME을 가진 파일을 검색하여 존재하면 true,
@@ -124,16 +535,44 @@ lookup(const struct dir *dir, const char *name,
 bool dir_lookup(const struct dir *dir, const char *name,
 				struct inode **inode)
 {
+	disk_sector_t parent;
 	struct dir_entry e;
+	struct dentry *d;
+	bool found;
 
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
 
-	if (lookup(dir, name, &e, NULL))		 // 디렉터리에 name이라는 엔트리가 있는지 검색
+	/* 이름 공간 락을 공유로 잡은 채 찾고 연다.
+	 * 그래야 찾은 직후 다른 스레드가 지운 inode를 열거나 캐시에 옛 결과를 넣지 않는다. */
+	inode_dir_acquire(dir->inode, false);
+
+	/* 먼저 dentry 캐시를 본다. */
+	parent = inode_get_inumber(dir->inode);
+	lock_acquire(&dentry_lock);
+	d = strlen(name) <= NAME_MAX ? dentry_find(parent, name) : NULL;
+	if (d != NULL)
+	{
+		found = !d->negative;
+		e.inode_sector = d->sector;
+		list_remove(&d->lru_elem);
+		list_push_front(&dentry_lru, &d->lru_elem);
+		lock_release(&dentry_lock);
+	}
+	else
+	{
+		lock_release(&dentry_lock);
+		found = lookup(dir, name, &e, NULL); // 디렉터리에 name이라는 엔트리가 있는지 검색
+		if (strlen(name) <= NAME_MAX)
+			dentry_insert(parent, name, !found, found ? e.inode_sector : 0);
+	}
+
+	if (found)
 		*inode = inode_open(e.inode_sector); // 있다
 	else
 		*inode = NULL; // 없다.
 
+	inode_dir_release(dir->inode, false);
 	return *inode != NULL;
 }
 
@@ -141,7 +580,7 @@ bool dir_lookup(const struct dir *dir, const char *name,
  * 파일의 inode는 INODE_SECTOR 섹터에 있습니다.
  * 성공하면 true를, 실패하면 false를 반환합니다.
  * NAME이 유효하지 않거나(즉, 너무 길거나), 디스크 또는 메모리 오류가 발생하면 실패합니다. */
-bool dir_add(struct dir *dir, const char *name, disk_sector_t inode_sector)
+bool dir_add(struct dir *dir, const char *name, disk_sector_t inode_sector, bool isdir)
 {
 	struct dir_entry e;
 	off_t ofs;
@@ -154,28 +593,50 @@ bool dir_add(struct dir *dir, const char *name, disk_sector_t inode_sector)
 	if (*name == '\0' || strlen(name) > NAME_MAX)
 		return false;
 
-	/* NAME이 이미 사용 중인지 확인한다. */
-	if (lookup(dir, name, NULL, NULL))
-		goto done;
+	if (!journal_begin(DIR_ADD_CREDITS))
+		return false;
+	inode_dir_acquire(dir->inode, true);
 
-	/* 빈 슬롯의 오프셋을 OFS에 설정한다.
-	 * 빈 슬롯이 없다면 현재 파일 끝 위치가 사용된다.
+	/* 이름 중복 확인과 빈 슬롯 찾기를 한 번의 탐색으로 끝낸다.
+	 * 빈 슬롯이 없다면 현재 파일 끝 위치가 사용되고,
+	 * 선형 디렉터리가 DIR_INDEX_THRESHOLD를 넘게 되면 색인 형식으로 바꾼다.
+	 * 바꾸지 못하면(메모리나 로그 자리가 모자라면) 선형 형식 그대로 끝에 붙인다. */
+	if (!inode_is_indexed(dir->inode))
+	{
+		if (scan(dir, 0, SIZE_MAX, name, NULL, NULL, &ofs))
+			goto done;
+		if (ofs < 0)
+		{
+			ofs = inode_length(dir->inode);
+			if (ofs / sizeof e >= DIR_INDEX_THRESHOLD)
+				dir_make_indexed(dir);
+		}
+	}
 
-	 * inode_read_at()은 파일 끝에서만 짧게 읽기를 반환하므로
-	 * 그 외의 경우라면 메모리 부족 등 일시적인 이유로 짧게
-	 * 읽은 것이 아님을 확인해야 한다. */
-	for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-		 ofs += sizeof e)
-		if (!e.in_use)
+	/* 색인 디렉터리는 NAME의 버킷에서 중복과 빈 슬롯을 함께 찾고,
+	 * 버킷이 가득 찼으면 그 버킷을 나누어 다시 찾는다. */
+	while (inode_is_indexed(dir->inode))
+	{
+		if (scan(dir, name_bucket(dir, name), DIR_BUCKET_ENTRIES, name, NULL, NULL, &ofs))
+			goto done;
+		if (ofs >= 0)
 			break;
+		if (!dir_split(dir, name))
+			goto done;
+	}
 
 	/* Write slot. */
 	e.in_use = true;
 	strlcpy(e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
+	e.isdir = isdir;
 	success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success)
+		dentry_invalidate(inode_get_inumber(dir->inode), name);
 
 done:
+	inode_dir_release(dir->inode, true);
+	journal_end();
 	return success;
 }
 
@@ -192,6 +653,10 @@ bool dir_remove(struct dir *dir, const char *name)
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
 
+	if (!journal_begin(DIR_ENTRY_CREDITS))
+		return false;
+	inode_dir_acquire(dir->inode, true);
+
 	/* Find directory entry. */
 	if (!lookup(dir, name, &e, &ofs))
 		goto done;
@@ -205,12 +670,17 @@ bool dir_remove(struct dir *dir, const char *name)
 	e.in_use = false;
 	if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
+	dentry_invalidate(inode_get_inumber(dir->inode), name);
 
 	/* Remove inode. */
 	inode_remove(inode);
 	success = true;
 
 done:
+	inode_dir_release(dir->inode, true);
+	journal_end();
+
+	/* 마지막 참조라면 블록 해제는 inode_close()가 자기 트랜잭션으로 한다. */
 	inode_close(inode);
 	return success;
 }
@@ -220,15 +690,50 @@ done:
 bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1])
 {
 	struct dir_entry e;
+	bool success = false;
 
-	while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+	inode_dir_acquire(dir->inode, false);
+	for (;;)
 	{
+		size_t left;
+		dir->pos = skip_padding(dir, dir->pos, &left);
+		if (inode_read_at(dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+			break;
 		dir->pos += sizeof e;
 		if (e.in_use)
 		{
 			strlcpy(name, e.name, NAME_MAX + 1);
-			return true;
+			success = true;
+			break;
 		}
 	}
-	return false;
+	inode_dir_release(dir->inode, false);
+	return success;
+}
+
+/* DIR의 현재 위치부터 사용 중인 엔트리를 최대 MAX개 ENTRIES에 읽어 온다.
+ * 슬롯을 버킷 하나씩 한꺼번에 읽으며, 읽은 엔트리 수를 반환한다 (끝이면 0). */
+size_t dir_read_entries(struct dir *dir, struct dir_entry *entries, size_t max)
+{
+	struct dir_entry slots[DIR_BUCKET_ENTRIES];
+	size_t cnt = 0;
+
+	inode_dir_acquire(dir->inode, false);
+	while (cnt < max)
+	{
+		size_t left;
+		dir->pos = skip_padding(dir, dir->pos, &left);
+		size_t n = max - cnt < DIR_BUCKET_ENTRIES ? max - cnt : DIR_BUCKET_ENTRIES;
+		if (n > left)
+			n = left;
+		n = inode_read_at(dir->inode, slots, n * sizeof slots[0], dir->pos) / sizeof slots[0];
+		if (n == 0)
+			break;
+		dir->pos += n * sizeof slots[0];
+		for (size_t i = 0; i < n; i++)
+			if (slots[i].in_use)
+				entries[cnt++] = slots[i];
+	}
+	inode_dir_release(dir->inode, false);
+	return cnt;
 }
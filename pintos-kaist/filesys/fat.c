@@ -1,8 +1,13 @@
 #include "filesys/fat.h"
 #include "devices/disk.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include <bitmap.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -10,11 +15,14 @@
 struct fat_boot
 {
 	unsigned int magic;				  /* FAT 파일 시스템임을 나타내는 숫자 */
-	unsigned int sectors_per_cluster; /* 항상 1로 고정 */
+	unsigned int sectors_per_cluster; /* 클러스터당 섹터 수 (포맷 시 1~64 중 선택) */
 	unsigned int total_sectors;		  /*디스크 전체 섹터 수*/
 	unsigned int fat_start;			  /*FAT 영역의 시작 섹터 번호*/
 	unsigned int fat_sectors;		  /* FAT 크기(섹터 단위) */
 	unsigned int root_dir_cluster;	  /*루트 디렉토리의 시작 클러스터 번호*/
+	unsigned int features;			  /* 포맷 시 선택한 기능 (FAT_FEATURE_*) */
+	unsigned int journal_start;		  /* 메타데이터 로그 영역의 시작 섹터 번호 */
+	unsigned int journal_sectors;	  /* 로그 영역 크기(섹터 단위). 0이면 저널 없음 */
 };
 
 /* FAT 파일 시스템 정보 */
@@ -25,13 +33,63 @@ struct fat_fs
 	unsigned int fat_length;  /* FAT 테이블의 섹터 수 (== bs.fat_sectors) */
 	disk_sector_t data_start; /* 실제 파일/디렉터리 데이터가 저장되는 영역의 시작 섹터 번호 */
 	cluster_t last_clst;	  /* FAT에서 최근에 할당된 마지막 클러스터 번호 (새 클러스터 할당 시 사용) */
+	cluster_t clst_limit;	  /* 데이터 영역에 실제로 존재하는 클러스터 번호의 상한 (미포함) */
 	struct lock write_lock;	  /* FAT 갱신 시 동기화를 위한 락 (write 동시성 제어용) */
+	struct lock alloc_lock;	  /* 클러스터 할당/해제와 빈 클러스터 색인 탐색을 직렬화한다. write_lock보다 먼저 잡는다. */
+	struct bitmap *dirty;	  /* FAT 섹터별 변경 여부 (1 = 다음 fat_sync 때 기록) */
+	struct bitmap *loaded;	  /* FAT 섹터별로 fat에 읽어 들였는지 여부. write_lock이 보호한다 */
+	struct bitmap *pending;	  /* 해제했지만 아직 커밋되지 않은 클러스터. write_lock이 보호한다 */
+	size_t pending_cnt;		  /* pending에 표시된 클러스터 수 */
+	struct list reservations; /* 클러스터가 남아 있는 예약 창(struct fat_reservation). alloc_lock이 보호한다 */
+	size_t reserved_cnt;	  /* 예약 창에 남은 클러스터 수의 합. 색인에서는 빠져 있다 */
 };
 
+/* 빈 클러스터 색인.
+ * bits는 클러스터당 1비트(1 = 빈 클러스터)이고, summary는 bits의 워드당 1비트로
+ * 그 워드에 빈 클러스터가 하나라도 있는지를 나타낸다.
+ * summary 워드 하나가 덮는 bits 64워드(4096 클러스터)를 블록이라 부르며,
+ * block_free에 블록별 빈 클러스터 수를 유지한다. */
+struct fat_free_index
+{
+	uint64_t *bits;		  /* 클러스터별 빈 칸 비트맵. */
+	uint64_t *summary;	  /* bits 워드별 "빈 칸 있음" 비트맵. */
+	uint32_t *block_free; /* 블록별 빈 클러스터 수. */
+	size_t word_cnt;	  /* bits의 워드 수. */
+	size_t free_cnt;	  /* 전체 빈 클러스터 수. */
+};
+
+#define FREE_INDEX_BITS 64 /* 워드 하나의 비트 수. */
+
+/* FAT 섹터 하나에 담기는 엔트리 수. */
+#define FAT_ENTRIES_PER_SECTOR (DISK_SECTOR_SIZE / sizeof(cluster_t))
+
+/* FAT 섹터를 읽어 들일 때 한 번에 읽는 최대 섹터 수. */
+#define FAT_LOAD_BATCH 8
+
+/* 파일 하나가 한 번에 예약해 두는 최대 클러스터 수. */
+#define FAT_RESERVE_WINDOW 8
+
+/* 위치 힌트 GOAL에서 이만큼 안에 있는 빈 구간이면 best-fit보다 우선한다. */
+#define FAT_NEAR_WINDOW 256
+
 static struct fat_fs *fat_fs;
+static struct fat_free_index free_index;
 
 void fat_boot_create(void);
 void fat_fs_init(void);
+static cluster_t extend_chain(cluster_t tail, size_t cnt, cluster_t goal, struct fat_reservation *resv);
+static cluster_t find_free_near(cluster_t goal);
+static bool discard_reservations(void);
+static void remove_chain(cluster_t clst, cluster_t pclst);
+static void fat_fault(cluster_t clst);
+static void load_sectors(size_t idx, size_t cnt);
+static bool load_next(void);
+static bool load_free(size_t cnt);
+static void fat_prefetchd(void *aux);
+static void free_index_init(void);
+static void free_index_set(cluster_t clst, bool free);
+static cluster_t free_index_next(cluster_t from);
+static size_t free_index_run_len(cluster_t clst);
 
 void fat_init(void)
 {
@@ -40,50 +98,37 @@ void fat_init(void)
 		PANIC("FAT init failed");
 
 	// 디스크에서 부트 섹터를 읽어 온다
-	unsigned int *bounce = malloc(DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC("FAT init failed");
-	disk_read(filesys_disk, FAT_BOOT_SECTOR, bounce);
-	memcpy(&fat_fs->bs, bounce, sizeof(fat_fs->bs));
-	free(bounce);
+	buffer_cache_read_at(FAT_BOOT_SECTOR, &fat_fs->bs, sizeof(fat_fs->bs), 0);
 
 	// FAT 정보 추출
-	if (fat_fs->bs.magic != FAT_MAGIC)
+	if (fat_fs->bs.magic != FAT_MAGIC || fat_fs->bs.sectors_per_cluster == 0 || fat_fs->bs.sectors_per_cluster > MAX_SECTORS_PER_CLUSTER)
 		fat_boot_create();
 	fat_fs_init();
+
+	// 커밋된 채 남은 트랜잭션이 있으면 FAT을 읽기 전에 제자리로 되살린다
+	journal_open(fat_fs->bs.journal_start, fat_fs->bs.journal_sectors);
 }
 
+/* 마운트 시 FAT을 백그라운드에서 미리 읽어 둘지 여부. 커널 옵션 -fat-prefetch로 켠다. */
+bool fat_prefetch = false;
+
 void fat_open(void)
 {
+	free(fat_fs->fat);
 	fat_fs->fat = calloc(fat_fs->fat_length, sizeof(cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC("FAT load failed");
 
-	// 디스크에서 FAT을 직접 읽어 온다
-	uint8_t *buffer = (uint8_t *)fat_fs->fat;
-	off_t bytes_read = 0;
-	off_t bytes_left = sizeof(fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof(cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++)
-	{
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE)
-		{
-			disk_read(filesys_disk, fat_fs->bs.fat_start + i,
-					  buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		}
-		else
-		{
-			uint8_t *bounce = malloc(DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC("FAT load failed");
-			disk_read(filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy(buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free(bounce);
-		}
-	}
+	// FAT은 마운트 시 읽지 않는다. 각 섹터는 처음 쓰일 때 버퍼 캐시를 거쳐 읽어 오고(fat_fault),
+	// 빈 클러스터 색인도 그때 그 섹터만큼 채운다.
+	free_index_init();
+	bitmap_set_all(fat_fs->loaded, false);
+	bitmap_set_all(fat_fs->dirty, false);
+	bitmap_set_all(fat_fs->pending, false);
+	fat_fs->pending_cnt = 0;
+
+	if (fat_prefetch)
+		thread_create("fat_prefetchd", PRI_MIN, fat_prefetchd, NULL);
 }
 
 void fat_close(void)
@@ -93,34 +138,92 @@ void fat_close(void)
 	if (bounce == NULL)
 		PANIC("FAT close failed");
 	memcpy(bounce, &fat_fs->bs, sizeof(fat_fs->bs));
-	disk_write(filesys_disk, FAT_BOOT_SECTOR, bounce);
+	buffer_cache_write(FAT_BOOT_SECTOR, bounce);
 	free(bounce);
 
-	// FAT을 디스크에 직접 기록
-	uint8_t *buffer = (uint8_t *)fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof(fat_fs->fat);
+	// 변경된 FAT 섹터만 기록 (디스크 반영은 buffer_cache_flush 시점)
+	fat_sync();
+}
+
+/* FAT의 IDX번째 섹터를 버퍼 캐시에 기록한다.
+ * META가 false면 로그를 거치지 않는 보통 섹터로 기록한다(포맷할 때). */
+static void
+fat_write_sector(size_t idx, bool meta)
+{
+	const uint8_t *buffer = (const uint8_t *)fat_fs->fat;
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof(cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++)
+	off_t ofs = idx * DISK_SECTOR_SIZE;
+	off_t bytes_left = fat_size_in_bytes - ofs;
+
+	const uint8_t *data = buffer + ofs;
+	uint8_t *bounce = NULL;
+
+	if (bytes_left < DISK_SECTOR_SIZE)
 	{
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE)
-		{
-			disk_write(filesys_disk, fat_fs->bs.fat_start + i,
-					   buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		}
-		else
-		{
-			bounce = calloc(1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC("FAT close failed");
-			memcpy(bounce, buffer + bytes_wrote, bytes_left);
-			disk_write(filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free(bounce);
-		}
+		bounce = calloc(1, DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC("FAT sync failed");
+		if (bytes_left > 0)
+			memcpy(bounce, buffer + ofs, bytes_left);
+		data = bounce;
 	}
+	if (meta)
+		buffer_cache_write_meta(fat_fs->bs.fat_start + idx, data);
+	else
+		buffer_cache_write(fat_fs->bs.fat_start + idx, data);
+	free(bounce);
+}
+
+/* 마지막 동기화 이후 변경된 FAT 섹터만 버퍼 캐시에 기록한다.
+ * 기록 전에 dirty 비트를 먼저 지우므로, 도중에 바뀐 섹터는 다음 동기화 때 다시 기록된다. */
+void fat_sync(void)
+{
+	lock_acquire(&fat_fs->write_lock);
+	size_t idx = bitmap_scan(fat_fs->dirty, 0, 1, true);
+	while (idx != BITMAP_ERROR)
+	{
+		bitmap_reset(fat_fs->dirty, idx);
+		fat_write_sector(idx, true);
+		idx = bitmap_scan(fat_fs->dirty, idx + 1, 1, true);
+	}
+	lock_release(&fat_fs->write_lock);
+}
+
+/* 커밋을 기다리던 해제 클러스터를 빈 클러스터 색인에 돌려준다.
+ * 해제를 담은 트랜잭션이 커밋된 뒤에 부른다. */
+void fat_commit_frees(void)
+{
+	lock_acquire(&fat_fs->alloc_lock);
+	lock_acquire(&fat_fs->write_lock);
+	size_t clst = 0;
+	while (fat_fs->pending_cnt > 0)
+	{
+		clst = bitmap_scan_and_flip(fat_fs->pending, clst, 1, true);
+		ASSERT(clst != BITMAP_ERROR);
+		ASSERT(fat_fs->fat[clst] == 0);
+		free_index_set(clst, true);
+		fat_fs->pending_cnt--;
+	}
+	lock_release(&fat_fs->write_lock);
+	lock_release(&fat_fs->alloc_lock);
+}
+
+/* 해제했지만 아직 커밋되지 않아 다시 쓸 수 없는 클러스터가 있으면 true. */
+bool fat_has_pending_frees(void)
+{
+	lock_acquire(&fat_fs->write_lock);
+	bool pending = fat_fs->pending_cnt > 0;
+	lock_release(&fat_fs->write_lock);
+	return pending;
+}
+
+/* 마지막 fat_sync() 이후 바뀐 FAT 섹터가 있으면 true. */
+bool fat_is_dirty(void)
+{
+	lock_acquire(&fat_fs->write_lock);
+	bool dirty = bitmap_any(fat_fs->dirty, 0, bitmap_size(fat_fs->dirty));
+	lock_release(&fat_fs->write_lock);
+	return dirty;
 }
 
 void fat_create(void)
@@ -128,44 +231,94 @@ void fat_create(void)
 	// FAT 부트 섹터 생성
 	fat_boot_create();
 	fat_fs_init();
+	journal_format(fat_fs->bs.journal_start, fat_fs->bs.journal_sectors);
 
 	// FAT 테이블 생성
 	fat_fs->fat = calloc(fat_fs->fat_length, sizeof(cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC("FAT creation failed");
 
+	// 새 테이블이므로 모든 FAT 섹터를 읽어 들인 것으로 표시
+	bitmap_set_all(fat_fs->loaded, true);
+
 	// ROOT_DIR_CLUSTER 설정
 	fat_put(ROOT_DIR_CLUSTER, EOChain);
 
-	// ROOT_DIR_CLUSTER 영역을 0으로 채움
+	// FAT 전체와 ROOT_DIR_CLUSTER 영역은 로그를 거치지 않고 기록한다.
+	// 포맷 도중에는 되살릴 이전 상태가 없고, FAT 전체는 로그 하나에 담기지도 않는다.
+	for (size_t idx = 0; idx < fat_fs->bs.fat_sectors; idx++)
+		fat_write_sector(idx, false);
+	bitmap_set_all(fat_fs->dirty, false);
+
 	uint8_t *buf = calloc(1, DISK_SECTOR_SIZE);
 	if (buf == NULL)
 		PANIC("FAT create failed due to OOM");
-	disk_write(filesys_disk, cluster_to_sector(ROOT_DIR_CLUSTER), buf);
+	for (unsigned i = 0; i < fat_fs->bs.sectors_per_cluster; i++)
+		buffer_cache_write(cluster_to_sector(ROOT_DIR_CLUSTER) + i, buf);
 	free(buf);
 }
 
+/* 포맷 시 사용할 클러스터당 섹터 수. 커널 옵션 -cs로 바꿀 수 있다. */
+unsigned int fat_format_cluster_sectors = SECTORS_PER_CLUSTER;
+
+/* 포맷 시 켤 기능 (FAT_FEATURE_*). 커널 옵션 -extents 등으로 바꿀 수 있다. */
+unsigned int fat_format_features = 0;
+
 void fat_boot_create(void)
 {
+	unsigned int spc = fat_format_cluster_sectors;
+	ASSERT(spc >= 1 && spc <= MAX_SECTORS_PER_CLUSTER);
+
+	/* 섹터 0은 부트 섹터, 섹터 1(ROOT_DIR_SECTOR)은 루트 디렉터리 inode이므로
+	 * 그 다음 섹터부터 메타데이터 로그 영역을 두고, FAT은 로그 뒤에 둔다. */
+	unsigned int journal_start = ROOT_DIR_SECTOR + 1;
+	unsigned int fat_start = journal_start + JOURNAL_SECTORS;
 	unsigned int fat_sectors =
-		(disk_size(filesys_disk) - 1) / (DISK_SECTOR_SIZE / sizeof(cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
+		(disk_size(filesys_disk) - fat_start - 1) / (FAT_ENTRIES_PER_SECTOR * spc + 1) + 1;
 	fat_fs->bs = (struct fat_boot){
 		.magic = FAT_MAGIC,
-		.sectors_per_cluster = SECTORS_PER_CLUSTER,
+		.sectors_per_cluster = spc,
 		.total_sectors = disk_size(filesys_disk),
-		.fat_start = 1,
+		.fat_start = fat_start,
 		.fat_sectors = fat_sectors,
 		.root_dir_cluster = ROOT_DIR_CLUSTER,
+		.features = fat_format_features,
+		.journal_start = journal_start,
+		.journal_sectors = JOURNAL_SECTORS,
 	};
 }
 
 void fat_fs_init(void)
 {
-	/* TODO: Your code goes here. */
-	fat_fs->fat_length = fat_fs->bs.fat_sectors * DISK_SECTOR_SIZE / (sizeof(cluster_t) * SECTORS_PER_CLUSTER);
+	fat_fs->fat_length = fat_fs->bs.fat_sectors * FAT_ENTRIES_PER_SECTOR;
 	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
 	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	fat_fs->clst_limit = (fat_fs->bs.total_sectors - fat_fs->data_start) / fat_fs->bs.sectors_per_cluster + 1;
+	if (fat_fs->clst_limit > fat_fs->fat_length)
+		fat_fs->clst_limit = fat_fs->fat_length;
 	lock_init(&fat_fs->write_lock);
+	lock_init(&fat_fs->alloc_lock);
+	list_init(&fat_fs->reservations);
+	fat_fs->reserved_cnt = 0;
+
+	if (fat_fs->dirty != NULL)
+		bitmap_destroy(fat_fs->dirty);
+	fat_fs->dirty = bitmap_create(fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty == NULL)
+		PANIC("FAT dirty map creation failed");
+
+	if (fat_fs->loaded != NULL)
+		bitmap_destroy(fat_fs->loaded);
+	fat_fs->loaded = bitmap_create(fat_fs->bs.fat_sectors);
+	if (fat_fs->loaded == NULL)
+		PANIC("FAT load map creation failed");
+
+	if (fat_fs->pending != NULL)
+		bitmap_destroy(fat_fs->pending);
+	fat_fs->pending = bitmap_create(fat_fs->fat_length);
+	if (fat_fs->pending == NULL)
+		PANIC("FAT pending map creation failed");
+	fat_fs->pending_cnt = 0;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -174,48 +327,191 @@ void fat_fs_init(void)
 
 /* 클러스터 체인에 새 클러스터를 추가한다.
  * CLST가 0이면 새로운 체인을 시작한다.
- * 새 클러스터 할당에 실패하면 0을 반환한다. */
+ * 새 클러스터 할당에 실패하면 0을 반환한다.
+ * CLST가 체인의 마지막 클러스터가 아니면 끝까지 따라가야 하므로,
+ * 꼬리를 알고 있는 호출자는 fat_extend_chain()을 쓰는 것이 좋다. */
 cluster_t
 fat_create_chain(cluster_t clst)
 {
-	/* TODO: Your code goes here. */
 	ASSERT(clst < fat_fs->fat_length);
 
-	unsigned int *fat = fat_fs->fat;
+	lock_acquire(&fat_fs->alloc_lock);
+	// 만약에라도 무한루프가 생기면 이쪽 확인할 것
+	// 이 코드가 문제가 아니라 get으로 나온게 EOChain인게 문제
+	if (clst != 0)
+		while (clst != ROOT_DIR_CLUSTER && fat_get(clst) != EOChain)
+			clst = fat_get(clst);
 
-	// 빈 클러스터 탐색
-	cluster_t new_clst = find_free_cluster();
-	if (new_clst == 0)
-		return 0;
+	clst = extend_chain(clst, 1, 0, NULL);
+	lock_release(&fat_fs->alloc_lock);
+	return clst;
+}
+
+/* 체인의 마지막 클러스터 TAIL 뒤에 CNT개의 클러스터를 한 번에 이어 붙인다.
+ * TAIL이 0이면 CNT개짜리 새 체인을 만든다.
+ * 성공하면 새로 붙은 첫 클러스터를, 공간이 모자라면 아무것도 바꾸지 않고 0을 반환한다.
+ * 체인을 걷지 않으므로 CNT에만 비례하는 시간이 든다. */
+cluster_t
+fat_extend_chain(cluster_t tail, size_t cnt)
+{
+	lock_acquire(&fat_fs->alloc_lock);
+	cluster_t first = extend_chain(tail, cnt, 0, NULL);
+	lock_release(&fat_fs->alloc_lock);
+	return first;
+}
 
-	fat_put(new_clst, EOChain);
+/* fat_extend_chain()과 같지만 새 클러스터를 파일의 예약 창 RESV에서 꺼낸다.
+ * 창이 비면 GOAL(0이면 TAIL 바로 뒤) 근처의 빈 구간을 FAT_RESERVE_WINDOW개까지 새로 예약한다.
+ * 예약된 클러스터는 빈 클러스터 색인에서 빠지므로, 동시에 늘어나는 다른 파일의
+ * 클러스터와 섞이지 않는다. */
+cluster_t
+fat_extend_reserved(cluster_t tail, size_t cnt, cluster_t goal, struct fat_reservation *resv)
+{
+	lock_acquire(&fat_fs->alloc_lock);
+	cluster_t first = extend_chain(tail, cnt, goal, resv);
+	lock_release(&fat_fs->alloc_lock);
+	return first;
+}
 
-	// 탐색 성공한 클러스터 번호를 저장(이후 탐색은 last_clst부터(=next_fit))
-	fat_fs->last_clst = new_clst;
-	if (clst == 0)
-		return new_clst;
+/* RESV에 남은 예약 클러스터를 빈 클러스터 색인에 돌려준다. alloc_lock을 잡고 호출한다. */
+static void
+drop_reservation(struct fat_reservation *resv)
+{
+	ASSERT(lock_held_by_current_thread(&fat_fs->alloc_lock));
+	if (resv->cnt == 0)
+		return;
 
-	// 만약에라도 무한루프가 생기면 이쪽 확인할 것
-	// 이 코드가 문제가 아니라 get으로 나온게 EOChain인게 문제
-	while (clst != ROOT_DIR_CLUSTER && fat_get(clst) != EOChain)
+	lock_acquire(&fat_fs->write_lock);
+	for (size_t i = 0; i < resv->cnt; i++)
+		if (fat_fs->fat[resv->start + i] == 0)
+			free_index_set(resv->start + i, true);
+	lock_release(&fat_fs->write_lock);
+	list_remove(&resv->elem);
+	fat_fs->reserved_cnt -= resv->cnt;
+	resv->cnt = 0;
+}
+
+/* RESV에 남은 예약 클러스터를 빈 클러스터 색인에 돌려준다. */
+void fat_unreserve(struct fat_reservation *resv)
+{
+	lock_acquire(&fat_fs->alloc_lock);
+	drop_reservation(resv);
+	lock_release(&fat_fs->alloc_lock);
+}
+
+/* 빈 클러스터가 모자랄 때 모든 파일의 예약 창을 색인에 돌려준다.
+ * 돌려준 클러스터가 있으면 true. alloc_lock을 잡고 호출한다. */
+static bool
+discard_reservations(void)
+{
+	ASSERT(lock_held_by_current_thread(&fat_fs->alloc_lock));
+	if (fat_fs->reserved_cnt == 0)
+		return false;
+	while (!list_empty(&fat_fs->reservations))
+		drop_reservation(list_entry(list_front(&fat_fs->reservations),
+									struct fat_reservation, elem));
+	return true;
+}
+
+/* RESV에서 클러스터 하나를 꺼낸다. 창이 비었으면 GOAL 근처에서 새로 예약한다.
+ * RESV가 NULL이면 GOAL 근처의 빈 클러스터를 바로 찾는다.
+ * 색인에 빈 클러스터가 없으면 다른 파일의 예약 창을 거둬 다시 찾는다. 그래도 없으면 0. */
+static cluster_t
+take_cluster(cluster_t goal, struct fat_reservation *resv)
+{
+	if (resv == NULL)
 	{
-		clst = fat_get(clst);
+		cluster_t clst = find_free_near(goal);
+		if (clst == 0 && discard_reservations())
+			clst = find_free_near(goal);
+		return clst;
 	}
 
-	fat_put(clst, new_clst);
-	return new_clst;
+	if (resv->cnt == 0)
+	{
+		cluster_t start = find_free_near(goal);
+		if (start == 0 && discard_reservations())
+			start = find_free_near(goal);
+		if (start == 0)
+			return 0;
+		size_t len = free_index_run_len(start);
+		if (len > FAT_RESERVE_WINDOW)
+			len = FAT_RESERVE_WINDOW;
+
+		lock_acquire(&fat_fs->write_lock);
+		for (size_t i = 0; i < len; i++)
+			free_index_set(start + i, false);
+		lock_release(&fat_fs->write_lock);
+		resv->start = start;
+		resv->cnt = len;
+		list_push_back(&fat_fs->reservations, &resv->elem);
+		fat_fs->reserved_cnt += len;
+	}
+	fat_fs->reserved_cnt--;
+	if (--resv->cnt == 0)
+		list_remove(&resv->elem);
+	return resv->start++;
+}
+
+/* fat_extend_chain()과 fat_extend_reserved()의 본체. alloc_lock을 잡고 호출해야 한다.
+ * 새 클러스터는 GOAL부터, GOAL이 0이면 TAIL 바로 뒤(새 체인이면 last_clst 뒤)부터 찾아
+ * 파일의 클러스터가 디스크에서 이어지도록 한다. */
+static cluster_t
+extend_chain(cluster_t tail, size_t cnt, cluster_t goal, struct fat_reservation *resv)
+{
+	ASSERT(lock_held_by_current_thread(&fat_fs->alloc_lock));
+	ASSERT(tail < fat_fs->fat_length);
+	ASSERT(cnt > 0);
+
+	cluster_t first = 0;
+	cluster_t prev = tail;
+	if (goal == 0)
+		goal = tail != 0 ? tail + 1 : fat_fs->last_clst + 1;
+	while (cnt-- > 0)
+	{
+		// 빈 클러스터 탐색
+		cluster_t new_clst = take_cluster(prev != 0 ? prev + 1 : goal, resv);
+		if (new_clst == 0)
+		{
+			/* 지금까지 붙인 클러스터를 되돌린다. */
+			if (first != 0)
+				remove_chain(first, tail);
+			return 0;
+		}
+
+		fat_put(new_clst, EOChain);
+		if (prev != 0)
+			fat_put(prev, new_clst);
+		if (first == 0)
+			first = new_clst;
+		prev = new_clst;
+
+		// 탐색 성공한 클러스터 번호를 저장(이후 탐색은 last_clst부터(=next_fit))
+		fat_fs->last_clst = new_clst;
+	}
+	return first;
 }
 
 /* CLST부터 시작하는 클러스터 체인을 제거한다.
  * PCLST가 0이면 CLST가 체인의 시작이라고 가정한다. */
 void fat_remove_chain(cluster_t clst, cluster_t pclst)
 {
+	lock_acquire(&fat_fs->alloc_lock);
+	remove_chain(clst, pclst);
+	lock_release(&fat_fs->alloc_lock);
+}
+
+/* fat_remove_chain()의 본체. alloc_lock을 잡고 호출해야 한다. */
+static void
+remove_chain(cluster_t clst, cluster_t pclst)
+{
+	ASSERT(lock_held_by_current_thread(&fat_fs->alloc_lock));
 	ASSERT(clst < fat_fs->fat_length);
 
 	if (pclst != 0)
 		fat_put(pclst, EOChain);
 
-	while (clst != EOChain)
+	while (clst != EOChain && clst != 0)
 	{
 		cluster_t next = fat_get(clst);
 		fat_put(clst, 0);
@@ -229,10 +525,48 @@ void fat_remove_chain(cluster_t clst, cluster_t pclst)
 	return;
 }
 
-/* FAT 테이블의 값을 갱신한다. */
+/* CLST의 엔트리가 담긴 FAT 섹터를 다음 fat_sync() 때 기록하도록 표시한다.
+ * 이번 트랜잭션에서 처음 바뀌는 섹터라면 로그 블록 하나를 쓴다. write_lock을 잡고 호출한다. */
+static void
+mark_dirty(cluster_t clst)
+{
+	size_t idx = clst / FAT_ENTRIES_PER_SECTOR;
+
+	ASSERT(lock_held_by_current_thread(&fat_fs->write_lock));
+	if (!bitmap_test(fat_fs->dirty, idx))
+	{
+		bitmap_mark(fat_fs->dirty, idx);
+		journal_charge(fat_fs->bs.fat_start + idx);
+	}
+}
+
+/* FAT 테이블의 값을 갱신한다.
+ * 엔트리가 채워지면 빈 클러스터 색인에서 뺀다. 엔트리가 비면, 저널을 쓰는 디스크에서는
+ * 해제가 커밋되기 전에 다른 파일이 그 클러스터를 받아 덮어쓰지 않도록 pending에 두었다가
+ * fat_commit_frees() 때 색인에 돌려준다.
+ * 클러스터를 해제(VAL == 0)하는 경우가 아니면 FAT_UNWRITTEN 표시는 유지한다. */
 void fat_put(cluster_t clst, cluster_t val)
 {
+	fat_fault(clst);
+	lock_acquire(&fat_fs->write_lock);
+	bool was_free = fat_fs->fat[clst] == 0;
+	if (val != 0)
+		val |= fat_fs->fat[clst] & FAT_UNWRITTEN;
 	fat_fs->fat[clst] = val;
+	if (was_free && val != 0)
+		free_index_set(clst, false);
+	else if (!was_free && val == 0)
+	{
+		if (journal_enabled())
+		{
+			bitmap_mark(fat_fs->pending, clst);
+			fat_fs->pending_cnt++;
+		}
+		else
+			free_index_set(clst, true);
+	}
+	mark_dirty(clst);
+	lock_release(&fat_fs->write_lock);
 	return;
 }
 
@@ -240,69 +574,275 @@ void fat_put(cluster_t clst, cluster_t val)
 cluster_t
 fat_get(cluster_t clst)
 {
-	return fat_fs->fat[clst];
+	fat_fault(clst);
+	return fat_fs->fat[clst] & ~FAT_UNWRITTEN;
 }
 
-/* 클러스터 번호를 섹터 번호로 변환한다. */
+/* 할당된 클러스터 CLST가 아직 한 번도 기록되지 않았으면 true.
+ * 그런 클러스터의 디스크 내용은 쓰레기이며 0으로 읽혀야 한다. */
+bool fat_is_unwritten(cluster_t clst)
+{
+	fat_fault(clst);
+	return (fat_fs->fat[clst] & FAT_UNWRITTEN) != 0;
+}
+
+/* 할당된 클러스터 CLST의 FAT_UNWRITTEN 표시를 켜거나 끈다. */
+void fat_set_unwritten(cluster_t clst, bool unwritten)
+{
+	fat_fault(clst);
+	lock_acquire(&fat_fs->write_lock);
+	ASSERT(fat_fs->fat[clst] != 0);
+	if (unwritten)
+		fat_fs->fat[clst] |= FAT_UNWRITTEN;
+	else
+		fat_fs->fat[clst] &= ~FAT_UNWRITTEN;
+	mark_dirty(clst);
+	lock_release(&fat_fs->write_lock);
+}
+
+/* 클러스터 번호를 그 클러스터의 첫 섹터 번호로 변환한다. */
 disk_sector_t
 cluster_to_sector(cluster_t clst)
 {
-	return fat_fs->data_start + (clst - 1);
+	return fat_fs->data_start + (clst - 1) * fat_fs->bs.sectors_per_cluster;
 }
 
-// 빈 클러스터 탐색
+/* 클러스터당 섹터 수를 반환한다. */
+unsigned int fat_sectors_per_cluster(void)
+{
+	return fat_fs->bs.sectors_per_cluster;
+}
+
+/* 현재 파일 시스템이 포맷 시 FEATURE 기능을 켜고 만들어졌는지 반환한다. */
+bool fat_has_feature(unsigned int feature)
+{
+	return (fat_fs->bs.features & feature) != 0;
+}
+
+/* 빈 클러스터 탐색.
+ * last_clst 다음부터 찾고(next-fit), 끝에 닿으면 처음(2)부터 다시 찾는다.
+ * 빈 클러스터 색인을 따라가므로 꽉 찬 구간은 워드/블록 단위로 건너뛴다.
+ * 없을 시 0 반환 */
 cluster_t find_free_cluster(void)
 {
-	cluster_t find_end = fat_fs->last_clst;
-	// last_clst는 할당되어 있으므로, last_clst + 1 위치부터 탐색 시작
-	cluster_t finding_clst = find_end + 1;
+	return find_free_near(fat_fs->last_clst + 1);
+}
+
+/* GOAL부터 FAT_NEAR_WINDOW개 클러스터의 엔트리가 든 FAT 섹터를 읽어 들여
+ * GOAL 근처의 빈 클러스터가 색인에 보이게 한다. */
+static void
+fault_near(cluster_t goal)
+{
+	if (goal < 2 || goal >= fat_fs->clst_limit)
+		return;
 
-	// 최대지점(fat_length) 도달 시 처음(2)로 돌아가 last_clst 까지 탐색
-	while (finding_clst != find_end)
+	cluster_t end = fat_fs->clst_limit - goal > FAT_NEAR_WINDOW ? goal + FAT_NEAR_WINDOW : fat_fs->clst_limit;
+	for (cluster_t clst = goal; clst < end; clst += FAT_ENTRIES_PER_SECTOR)
+		fat_fault(clst);
+	fat_fault(end - 1);
+}
+
+/* GOAL 이상인 첫 빈 클러스터를 찾고, 끝에 닿으면 처음(2)부터 다시 찾는다. 없으면 0. */
+static cluster_t
+find_free_near(cluster_t goal)
+{
+	fault_near(goal);
+	cluster_t clst = free_index_next(goal);
+	if (clst == 0)
 	{
-		if (fat_get(finding_clst) == 0)
-			return finding_clst;
+		load_free(1);
+		clst = free_index_next(goal);
+		if (clst == 0)
+			clst = free_index_next(2);
+	}
+	return clst;
+}
+
+/* SECTOR에 있는 inode 근처에 무언가를 둘 때 쓸 위치 힌트(클러스터 번호).
+ * 데이터 영역 밖의 섹터(루트 inode 등)라면 데이터 영역의 처음을 가리킨다. */
+cluster_t fat_hint(disk_sector_t sector)
+{
+	if (sector < fat_fs->data_start)
+		return ROOT_DIR_CLUSTER + 1;
+	return sector_to_cluster(sector) + 1;
+}
 
-		finding_clst++;
+/* FROM부터 시작하는 빈 클러스터 구간을 찾아 시작 클러스터를 반환한다.
+ * 구간 길이는 최대 CNT로 잘라 *LENP에 저장한다. 빈 클러스터가 없으면 0을 반환한다. */
+cluster_t fat_find_free_run(cluster_t from, size_t cnt, size_t *lenp)
+{
+	lock_acquire(&fat_fs->alloc_lock);
+	fault_near(from);
+	load_free(1);
+	cluster_t start = free_index_next(from);
+	size_t len = 0;
 
-		if (finding_clst == fat_fs->fat_length)
-			finding_clst = 2;
+	/* FAT 값이 0이어도 다른 파일이 예약해 둔 클러스터일 수 있으므로 색인으로 센다. */
+	if (start != 0)
+	{
+		len = free_index_run_len(start);
+		if (len > cnt)
+			len = cnt;
 	}
+	lock_release(&fat_fs->alloc_lock);
+	*lenp = len;
+	return start;
+}
 
-	// 없을 시 0 반환
-	return 0;
+/* 빈 클러스터 수를 반환한다. 예약 창에 남은 클러스터는 모자라면 거둬 쓰므로 함께 센다.
+ * 아직 읽지 않은 FAT 섹터가 있으면 모두 읽어 들인 뒤에 세므로, 처음 한 번을 빼면 O(1)이다. */
+size_t fat_free_clusters(void)
+{
+	while (load_next())
+		continue;
+	lock_acquire(&fat_fs->alloc_lock);
+	size_t cnt = free_index.free_cnt + fat_fs->reserved_cnt;
+	lock_release(&fat_fs->alloc_lock);
+	return cnt;
+}
+
+/* START부터 LEN개의 연속된 빈 클러스터를 PREV 뒤에 이어 붙이고 마지막 클러스터를 반환한다.
+ * PREV가 0이면 START가 체인의 시작이 된다. */
+static cluster_t
+link_run(cluster_t prev, cluster_t start, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		fat_put(start + i, EOChain);
+		if (prev != 0)
+			fat_put(prev, start + i);
+		prev = start + i;
+	}
+	return prev;
 }
 
-/* 파일을 처음 만들 때 섹터를 할당 */
+/* CNT개를 담을 빈 구간 중 가장 잘 맞는 것을 찾는다(best-fit).
+ * 다만 GOAL 뒤 FAT_NEAR_WINDOW 안에 CNT개가 한 번에 들어가는 구간이 있으면 그것을 쓴다.
+ * 읽지 않은 FAT 섹터의 구간을 놓치지 않도록, GOAL 근처를 먼저 읽고 best-fit 전에 FAT 전체를 읽는다.
+ * CNT 이상인 구간 중 가장 짧은 것을 고르며, 그런 구간이 없다면 가장 긴 구간을 고른다.
+ * 구간 시작을 반환하고 길이(최대 CNT)를 *LENP에 저장한다. 빈 클러스터가 없으면 0. */
+static cluster_t
+find_best_run(size_t cnt, cluster_t goal, size_t *lenp)
+{
+	cluster_t best = 0, largest = 0;
+	size_t best_len = 0, largest_len = 0;
+
+	if (goal != 0)
+	{
+		fault_near(goal);
+		cluster_t near = free_index_next(goal);
+		while (near != 0 && near - goal < FAT_NEAR_WINDOW)
+		{
+			size_t len = free_index_run_len(near);
+			if (len >= cnt)
+			{
+				*lenp = cnt;
+				return near;
+			}
+			near = free_index_next(near + len);
+		}
+	}
+
+	while (load_next())
+		continue;
+	cluster_t clst = free_index_next(2);
+	while (clst != 0)
+	{
+		size_t len = free_index_run_len(clst);
+		if (len >= cnt && (best == 0 || len < best_len))
+		{
+			best = clst;
+			best_len = len;
+			if (len == cnt)
+				break;
+		}
+		if (len > largest_len)
+		{
+			largest = clst;
+			largest_len = len;
+		}
+		clst = free_index_next(clst + len);
+	}
+
+	if (best != 0)
+	{
+		*lenp = cnt;
+		return best;
+	}
+	*lenp = largest_len;
+	return largest;
+}
+
+/* 파일을 처음 만들 때 섹터를 할당.
+ * CNT개가 한 번에 들어가는 연속 구간을 우선 찾고, 없다면 가장 긴 구간부터 채워
+ * 조각 수를 최소로 한다. 빈 클러스터가 모자라면 아무것도 할당하지 않는다. */
 bool fat_allocate(size_t cnt, cluster_t *clusterp)
+{
+	return fat_allocate_near(cnt, 0, clusterp);
+}
+
+/* fat_allocate()와 같지만 GOAL(fat_hint()) 근처에 두기를 우선한다. GOAL이 0이면 힌트가 없다. */
+bool fat_allocate_near(size_t cnt, cluster_t goal, cluster_t *clusterp)
 {
 	if (cnt == 0)
 		return true;
-	ASSERT(cnt > 0);
-
-	cluster_t start = fat_create_chain(0); // 첫번째 클러스터
-	cnt--;
 
-	cluster_t prev = start;
+	/* 한 클러스터짜리는 GOAL부터(없으면 next-fit) 찾으면 충분하다. */
+	if (cnt == 1)
+	{
+		lock_acquire(&fat_fs->alloc_lock);
+		cluster_t start = extend_chain(0, 1, goal, NULL);
+		lock_release(&fat_fs->alloc_lock);
+		if (start != 0)
+			*clusterp = start;
+		return start != 0;
+	}
 
-	while (prev != 0 && cnt > 0)
+	lock_acquire(&fat_fs->alloc_lock);
+	if (!load_free(cnt) && !(discard_reservations() && load_free(cnt)))
 	{
-		/* 클러스터 체인 만들기 */
-		prev = fat_create_chain(prev);
-		cnt--;
+		lock_release(&fat_fs->alloc_lock);
+		return false;
 	}
 
-	/* 섹터에 충분한 공간이 남지 않았으면 */
-	if (cnt != 0)
+	cluster_t start = 0, tail = 0;
+	while (cnt > 0)
 	{
-		/* 만들던 체인 모두 삭제 */
-		fat_remove_chain(start, 0);
+		size_t len;
+		cluster_t run = find_best_run(cnt, goal, &len);
+		ASSERT(run != 0 && len > 0);
+
+		tail = link_run(tail, run, len);
+		if (start == 0)
+			start = run;
+		fat_fs->last_clst = tail;
+		cnt -= len;
 	}
-	else
-		/* 클러스터 체인 시작 번호 대입 */
-		*clusterp = start;
+	lock_release(&fat_fs->alloc_lock);
+	*clusterp = start;
+	return true;
+}
 
-	return start != 0;
+/* CNT개의 연속된 빈 클러스터를 하나의 새 체인으로 할당하고 첫 클러스터를 반환한다.
+ * GOAL 근처의 구간을 우선하며, 한 번에 들어가는 구간이 없으면 아무것도 하지 않고 0을 반환한다. */
+cluster_t fat_allocate_contiguous(size_t cnt, cluster_t goal)
+{
+	ASSERT(cnt > 0);
+
+	lock_acquire(&fat_fs->alloc_lock);
+	while (load_next())
+		continue;
+
+	size_t len;
+	cluster_t run = find_best_run(cnt, goal, &len);
+	if ((run == 0 || len < cnt) && discard_reservations())
+		run = find_best_run(cnt, goal, &len);
+	if (run != 0 && len == cnt)
+		link_run(0, run, cnt);
+	else
+		run = 0;
+	lock_release(&fat_fs->alloc_lock);
+	return run;
 }
 
 void fat_release(cluster_t clst)
@@ -310,7 +850,225 @@ void fat_release(cluster_t clst)
 	fat_remove_chain(clst, 0);
 }
 
+/* CLST부터 시작하는 체인을 앞에서부터 해제하되, 바뀌는 FAT 섹터가 SECTORS개를 넘기 전에 멈춘다.
+ * 섹터가 바뀔 때마다 새 섹터로 세므로 실제로 바뀌는 섹터 수는 이보다 적을 수 있다.
+ * 해제하지 못한 나머지 체인의 첫 클러스터를 반환하며, 모두 해제했으면 0을 반환한다. */
+cluster_t fat_release_bounded(cluster_t clst, size_t sectors)
+{
+	size_t last = SIZE_MAX, cnt = 0;
+
+	lock_acquire(&fat_fs->alloc_lock);
+	while (clst != EOChain && clst != 0)
+	{
+		size_t idx = clst / FAT_ENTRIES_PER_SECTOR;
+		if (idx != last)
+		{
+			if (cnt == sectors)
+				break;
+			cnt++;
+			last = idx;
+		}
+
+		cluster_t next = fat_get(clst);
+		fat_put(clst, 0);
+		if (fat_fs->last_clst == clst)
+			fat_fs->last_clst = 2;
+		clst = next;
+	}
+	lock_release(&fat_fs->alloc_lock);
+	return clst == EOChain ? 0 : clst;
+}
+
+/* SECTOR가 속한 클러스터 번호를 반환한다. */
 cluster_t sector_to_cluster(disk_sector_t sector)
 {
-	return (sector - fat_fs->data_start) + 1;
+	return (sector - fat_fs->data_start) / fat_fs->bs.sectors_per_cluster + 1;
+}
+
+/*----------------------------------------------------------------------------*/
+/* FAT 지연 로딩                                                               */
+/*----------------------------------------------------------------------------*/
+
+/* CLST의 엔트리가 담긴 FAT 섹터를 아직 읽지 않았다면 읽어 들인다.
+ * 체인을 따라가는 경우가 많으므로 뒤따르는 섹터도 FAT_LOAD_BATCH개까지 함께 읽는다. */
+static void
+fat_fault(cluster_t clst)
+{
+	size_t idx = clst / FAT_ENTRIES_PER_SECTOR;
+	if (!bitmap_test(fat_fs->loaded, idx))
+		load_sectors(idx, FAT_LOAD_BATCH);
+}
+
+/* IDX번째 FAT 섹터부터 최대 CNT개 중, 앞쪽의 아직 읽지 않은 연속 구간을 버퍼 캐시를 거쳐
+ * fat으로 읽어 들이고 그 안의 빈 클러스터를 색인에 더한다.
+ * 이미 읽은 섹터는 메모리 쪽이 최신이므로 다시 읽지 않는다. */
+static void
+load_sectors(size_t idx, size_t cnt)
+{
+	lock_acquire(&fat_fs->write_lock);
+	size_t n = 0;
+	while (n < cnt && idx + n < fat_fs->bs.fat_sectors && !bitmap_test(fat_fs->loaded, idx + n))
+		n++;
+	if (n > 0)
+	{
+		buffer_cache_read_multi(fat_fs->bs.fat_start + idx, n,
+								fat_fs->fat + idx * FAT_ENTRIES_PER_SECTOR);
+		cluster_t first = idx * FAT_ENTRIES_PER_SECTOR;
+		for (cluster_t clst = first; clst < first + n * FAT_ENTRIES_PER_SECTOR; clst++)
+			if (fat_fs->fat[clst] == 0)
+				free_index_set(clst, true);
+		bitmap_set_multiple(fat_fs->loaded, idx, n, true);
+	}
+	lock_release(&fat_fs->write_lock);
+}
+
+/* 아직 읽지 않은 첫 FAT 구간을 읽어 들인다. 모두 읽었으면 false. */
+static bool
+load_next(void)
+{
+	lock_acquire(&fat_fs->write_lock);
+	size_t idx = bitmap_scan(fat_fs->loaded, 0, 1, false);
+	lock_release(&fat_fs->write_lock);
+	if (idx == BITMAP_ERROR)
+		return false;
+	load_sectors(idx, FAT_LOAD_BATCH);
+	return true;
+}
+
+/* 색인에 빈 클러스터가 CNT개 이상 보일 때까지 FAT 섹터를 앞에서부터 더 읽어 들인다.
+ * FAT을 모두 읽고도 모자라면 false를 반환한다. */
+static bool
+load_free(size_t cnt)
+{
+	while (free_index.free_cnt < cnt)
+		if (!load_next())
+			return false;
+	return true;
+}
+
+/* 남은 FAT 섹터를 백그라운드에서 읽어 들이는 스레드.
+ * 가장 낮은 우선순위로 돌며, 다 읽으면 끝난다. */
+static void
+fat_prefetchd(void *aux UNUSED)
+{
+	while (load_next())
+		thread_yield();
+}
+
+/*----------------------------------------------------------------------------*/
+/* 빈 클러스터 색인                                                             */
+/*----------------------------------------------------------------------------*/
+
+/* 빈 클러스터 색인을 비어 있는 상태로 새로 만든다.
+ * FAT 섹터를 읽어 들일 때마다 그 섹터의 빈 클러스터가 더해진다(load_sectors).
+ * 클러스터 0은 쓰지 않고 1은 루트 디렉터리이므로 2부터 센다. */
+static void
+free_index_init(void)
+{
+	free(free_index.bits);
+	free(free_index.summary);
+	free(free_index.block_free);
+
+	size_t word_cnt = DIV_ROUND_UP(fat_fs->clst_limit, FREE_INDEX_BITS);
+	size_t block_cnt = DIV_ROUND_UP(word_cnt, FREE_INDEX_BITS);
+	free_index.bits = calloc(word_cnt, sizeof *free_index.bits);
+	free_index.summary = calloc(block_cnt, sizeof *free_index.summary);
+	free_index.block_free = calloc(block_cnt, sizeof *free_index.block_free);
+	if (free_index.bits == NULL || free_index.summary == NULL || free_index.block_free == NULL)
+		PANIC("FAT free index creation failed");
+	free_index.word_cnt = word_cnt;
+	free_index.free_cnt = 0;
+}
+
+/* CLST의 빈 칸 비트를 FREE로 바꾸고 요약 정보를 갱신한다. */
+static void
+free_index_set(cluster_t clst, bool free)
+{
+	if (free_index.bits == NULL || clst < 2 || clst >= fat_fs->clst_limit)
+		return;
+
+	size_t w = clst / FREE_INDEX_BITS;
+	size_t b = w / FREE_INDEX_BITS;
+	uint64_t bit = 1ULL << (clst % FREE_INDEX_BITS);
+	uint64_t word_bit = 1ULL << (w % FREE_INDEX_BITS);
+
+	if (free == ((free_index.bits[w] & bit) != 0))
+		return;
+
+	if (free)
+	{
+		free_index.bits[w] |= bit;
+		free_index.summary[b] |= word_bit;
+		free_index.block_free[b]++;
+		free_index.free_cnt++;
+	}
+	else
+	{
+		free_index.bits[w] &= ~bit;
+		if (free_index.bits[w] == 0)
+			free_index.summary[b] &= ~word_bit;
+		free_index.block_free[b]--;
+		free_index.free_cnt--;
+	}
+}
+
+/* FROM 이상인 첫 빈 클러스터를 반환한다. 없으면 0.
+ * 현재 워드를 먼저 보고, 이후로는 summary 비트를 따라 빈 칸이 있는 워드로만 이동한다. */
+static cluster_t
+free_index_next(cluster_t from)
+{
+	if (from < 2)
+		from = 2;
+	if (free_index.bits == NULL || from >= fat_fs->clst_limit)
+		return 0;
+
+	size_t w = from / FREE_INDEX_BITS;
+	uint64_t m = free_index.bits[w] & (~0ULL << (from % FREE_INDEX_BITS));
+	if (m != 0)
+		return w * FREE_INDEX_BITS + __builtin_ctzll(m);
+
+	for (size_t i = w + 1; i < free_index.word_cnt;)
+	{
+		size_t b = i / FREE_INDEX_BITS;
+		uint64_t sm = free_index.summary[b] & (~0ULL << (i % FREE_INDEX_BITS));
+		if (sm != 0)
+		{
+			size_t ww = b * FREE_INDEX_BITS + __builtin_ctzll(sm);
+			return ww * FREE_INDEX_BITS + __builtin_ctzll(free_index.bits[ww]);
+		}
+		i = (b + 1) * FREE_INDEX_BITS;
+	}
+	return 0;
+}
+
+/* CLST부터 연속된 빈 클러스터 수를 반환한다.
+ * 블록 전체가 비어 있으면 block_free를 보고 한 번에 4096개씩,
+ * 워드 전체가 비어 있으면 한 번에 64개씩 센다. */
+static size_t
+free_index_run_len(cluster_t clst)
+{
+	const size_t block_clusters = FREE_INDEX_BITS * FREE_INDEX_BITS;
+	size_t len = 0;
+
+	while (clst + len < fat_fs->clst_limit)
+	{
+		cluster_t cur = clst + len;
+		size_t w = cur / FREE_INDEX_BITS;
+		if (cur % block_clusters == 0 && free_index.block_free[cur / block_clusters] == block_clusters)
+		{
+			len += block_clusters;
+			continue;
+		}
+		if (cur % FREE_INDEX_BITS == 0 && free_index.bits[w] == ~0ULL)
+		{
+			len += FREE_INDEX_BITS;
+			continue;
+		}
+		if ((free_index.bits[w] & (1ULL << (cur % FREE_INDEX_BITS))) == 0)
+			break;
+		len++;
+	}
+	if (clst + len > fat_fs->clst_limit)
+		len = fat_fs->clst_limit - clst;
+	return len;
 }
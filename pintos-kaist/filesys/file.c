@@ -11,6 +11,8 @@ struct file
 	off_t pos;			 /* 현재 위치. */
 	bool deny_write;	 /* file_deny_write()가 호출되었는지 여부. */
 	int dup_count;		 /* extra2 */
+	off_t ra_pos;		 /* 직전 file_read()가 끝난 위치 (순차 읽기 감지용). */
+	off_t ra_end;		 /* 이 파일로 read-ahead를 이미 요청한 바이트 위치. */
 };
 
 /* 주어진 INODE를 사용하여 파일을 열고 해당 소유권을 가져온 후
@@ -46,6 +48,8 @@ file_open(struct inode *inode)
 		/* extra 2 */
 		file->dup_count = 1;
 		file->deny_write = false;
+		file->ra_pos = 0;
+		file->ra_end = 0;
 		return file;
 	}
 	else
@@ -102,8 +106,17 @@ file_get_inode(struct file *file)
  * 파일의 현재 위치(FILE->pos)는 읽은 바이트 수만큼 앞으로 이동합니다. */
 off_t file_read(struct file *file, void *buffer, off_t size)
 {
+	bool sequential = file->pos == file->ra_pos;
 	off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
+	file->ra_pos = file->pos;
+
+	/* 순차적으로 읽고 있다면 다음 섹터들을 미리 읽어 둔다.
+	 * 뒤로 가거나 건너뛰었다면 요청해 둔 창이 맞지 않으므로 새로 시작한다. */
+	if (!sequential)
+		file->ra_end = 0;
+	else if (bytes_read > 0)
+		file->ra_end = inode_readahead(file->inode, file->pos, file->ra_end);
 	return bytes_read;
 }
 
@@ -7,13 +7,30 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/fat.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
 #include "devices/disk.h"
+#include "devices/timer.h"
 #include "include/threads/thread.h"
+#include "threads/synch.h"
 
 /* 파일 시스템을 담고 있는 디스크. */
 struct disk *filesys_disk;
 
+/* 주기적으로 변경된 메타데이터와 캐시를 디스크에 기록하는 간격(틱). */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* group commit 상태.
+ * sync_started번째까지의 동기화가 시작되었고 sync_done번째까지 끝났다.
+ * 동기화가 도는 동안 들어온 호출자들은 다음 동기화 한 번을 함께 기다린다. */
+static struct lock sync_lock;
+static struct condition sync_cond;
+static unsigned sync_started;
+static unsigned sync_done;
+
 static void do_format(void);
+static void sync_now(void);
+static void filesys_flushd(void *aux);
 
 /* 파일 시스템 모듈을 초기화합니다. FORMAT이 true라면 파일 시스템을 재포맷합니다. */
 void filesys_init(bool format)
@@ -22,7 +39,12 @@ void filesys_init(bool format)
 	if (filesys_disk == NULL)
 		PANIC("hd0:1 (hdb) not present, file system initialization failed");
 
+	buffer_cache_init();
+	journal_init();
+	lock_init(&sync_lock);
+	cond_init(&sync_cond);
 	inode_init();
+	dir_cache_init();
 
 #ifdef EFILESYS
 	fat_init();
@@ -31,6 +53,9 @@ void filesys_init(bool format)
 		do_format();
 
 	fat_open();
+	/* -crash-on-sync로 시험할 때는 주기적 커밋이 테스트의 커밋을 앞지르지 않도록 띄우지 않는다. */
+	if (!journal_crash_on_sync)
+		thread_create("filesys_flushd", PRI_DEFAULT, filesys_flushd, NULL);
 #else
 	/* 기존 파일 시스템 */
 	free_map_init();
@@ -45,12 +70,88 @@ void filesys_init(bool format)
 /* 파일 시스템 모듈을 종료하며 남아 있는 데이터를 디스크에 기록합니다. */
 void filesys_done(void)
 {
+	inode_release_deferred();
+	inode_flush_all();
+
 	/* 기존 파일 시스템 */
 #ifdef EFILESYS
 	fat_close();
 #else
 	free_map_close();
 #endif
+	buffer_cache_done();
+}
+
+/* 열린 inode의 메타데이터, 변경된 FAT 섹터, 버퍼 캐시의 dirty 섹터를
+ * 모두 디스크에 기록합니다.
+ * 호출 이후에 시작된 동기화 한 번이 끝날 때까지 기다리며, 동시에 부른 호출자들은
+ * 같은 동기화를 공유합니다(group commit). */
+void filesys_sync(void)
+{
+	lock_acquire(&sync_lock);
+	unsigned target = sync_started + 1;
+	while ((int)(sync_done - target) < 0)
+	{
+		if (sync_started == sync_done)
+		{
+			/* 도는 동기화가 없으면 이 스레드가 대표로 기록한다. */
+			sync_started++;
+			lock_release(&sync_lock);
+			sync_now();
+			lock_acquire(&sync_lock);
+			sync_done++;
+			cond_broadcast(&sync_cond, &sync_lock);
+		}
+		else
+			cond_wait(&sync_cond, &sync_lock);
+	}
+	lock_release(&sync_lock);
+}
+
+/* INODE의 데이터를 디스크에 기록합니다.
+ * DATA_ONLY가 false이거나 데이터를 찾는 데 필요한 메타데이터(inode 길이, FAT)가
+ * 아직 커밋되지 않았다면 filesys_sync()와 같고, 그렇지 않으면 캐시의 파일 데이터만
+ * 기록하여 저널 커밋을 건너뜁니다. */
+void filesys_fsync(struct inode *inode, bool data_only)
+{
+	if (data_only && !inode_is_dirty(inode)
+#ifdef EFILESYS
+		&& !fat_is_dirty()
+#endif
+		&& buffer_cache_flush_data())
+		return;
+	filesys_sync();
+}
+
+/* filesys_sync()의 본체. 진행 중인 연산이 끝나기를 기다렸다가 모으므로
+ * 메타데이터는 연산 단위로 커밋됩니다. */
+static void
+sync_now(void)
+{
+	journal_quiesce();
+	inode_flush_all();
+#ifdef EFILESYS
+	fat_sync();
+#endif
+	buffer_cache_flush();
+#ifdef EFILESYS
+	/* 해제가 커밋되었으므로 이제 그 클러스터를 다시 나눠 줄 수 있다. */
+	fat_commit_frees();
+#endif
+	journal_resume();
+}
+
+/* FLUSH_INTERVAL마다 filesys_sync()를 호출하는 커널 스레드.
+ * 비정상 종료 시 잃어버릴 수 있는 할당 정보와 데이터의 범위를 줄입니다. */
+static void
+filesys_flushd(void *aux UNUSED)
+{
+	for (;;)
+	{
+		timer_sleep(FLUSH_INTERVAL);
+		inode_release_deferred();
+		filesys_sync();
+	}
 }
 
 /* NAME 이름으로 INITIAL_SIZE 크기의 파일을 생성합니다.
@@ -85,7 +186,22 @@ bool filesys_create(const char *name, off_t initial_size)
 	}
 	name = path_lst[path_cnt - 1];
 
-	bool success = (cur_dir != NULL && name != NULL && strlen(name) <= 14 && fat_allocate(1, &inode_clst) && inode_create(cluster_to_sector(inode_clst), initial_size, false) && dir_add(cur_dir, name, cluster_to_sector(inode_clst)));
+	/* inode 클러스터 할당, inode 생성, 디렉터리 추가를 한 트랜잭션으로 묶는다.
+	 * 로그에 담기도록 처음에는 INODE_CREATE_MAX까지만 만들고, 나머지는 뒤에서 늘린다. */
+	off_t create_size = initial_size < INODE_CREATE_MAX ? initial_size : INODE_CREATE_MAX;
+	if (!journal_begin(1 + INODE_CREATE_CREDITS + DIR_ADD_CREDITS))
+		return false;
+	bool success = (cur_dir != NULL && name != NULL && strlen(name) <= 14 && fat_allocate_near(1, fat_hint(inode_get_inumber(dir_get_inode(cur_dir))), &inode_clst) && inode_create(cluster_to_sector(inode_clst), create_size, false) && dir_add(cur_dir, name, cluster_to_sector(inode_clst), false));
+	journal_end();
+
+	if (success && initial_size > create_size)
+	{
+		struct inode *inode = inode_open(cluster_to_sector(inode_clst));
+		success = inode != NULL && inode_grow(inode, initial_size);
+		inode_close(inode);
+		if (!success)
+			dir_remove(cur_dir, name);
+	}
 	if (!success && inode_sector != 0)
 		dprintf("[%s] fail to filesys_create !!\n", name);
 
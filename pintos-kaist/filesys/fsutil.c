@@ -6,6 +6,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "devices/disk.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
@@ -185,3 +186,27 @@ void fsutil_get(char **argv)
 	file_close(src);
 	free(buffer);
 }
+
+/* 파일 ARGV[1]의 클러스터를 하나의 연속 구간으로 옮기고
+ * 옮기기 전과 후의 조각 수를 출력합니다. */
+void fsutil_defrag(char **argv)
+{
+	const char *file_name = argv[1];
+	size_t before, after;
+
+	printf("'%s' 파일을 조각 모음합니다...\n", file_name);
+	struct file *file = filesys_open(file_name);
+	if (file == NULL)
+		PANIC("%s: open failed", file_name);
+
+	struct inode *inode = file_get_inode(file);
+	bool success = inode_defrag(inode, &before, &after);
+	printf("%s: 조각 %zu개 -> %zu개%s\n", file_name, before, after,
+		   success ? "" : " (연속된 빈 공간 없음)");
+
+	/* 디렉터리라면 filesys_open()은 struct dir을 돌려준다. */
+	if (is_dir(inode))
+		dir_close((struct dir *)file);
+	else
+		file_close(file);
+}
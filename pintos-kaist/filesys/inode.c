@@ -1,25 +1,84 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "filesys/fat.h"
+#include "filesys/journal.h"
+#include "filesys/page_cache.h"
+#include "threads/synch.h"
 
 /* inode를 식별하는 매직 넘버. */
 #define INODE_MAGIC 0x494e4f44
 
+/* 익스텐트: START부터 LENGTH개의 연속된 클러스터. */
+struct inode_extent
+{
+	cluster_t start;
+	uint32_t length;
+};
+
+/* inode 섹터에 직접 담는 익스텐트 수와 간접 익스텐트 블록에 담는 익스텐트 수. */
+#define DIRECT_EXTENTS 61
+#define INDIRECT_EXTENTS 63
+#define MAX_EXTENTS (DIRECT_EXTENTS + INDIRECT_EXTENTS)
+
+/* inode_read_at()이 디스크 명령 하나로 읽는 최대 섹터 수. */
+#define READ_RUN_MAX 8
+
+/* inode 섹터 안에 직접 담을 수 있는 파일 데이터의 최대 크기. */
+#define INLINE_MAX 496
+
+/* inode_write_at()이 한 트랜잭션에서 쓰거나 늘리는 최대 바이트 수. */
+#define WRITE_CHUNK (8 * DISK_SECTOR_SIZE)
+
+/* inode_disk의 flags 비트. */
+#define INODE_INLINE 0x1	/* 데이터가 클러스터 대신 inline_data에 있다. */
+#define INODE_INDEXED 0x2	/* 디렉터리가 해시 버킷 형식이다 (directory.c). */
+
 /* 디스크에 기록되는 inode 구조체.
- * 크기는 정확히 DISK_SECTOR_SIZE 바이트여야 한다. */
+ * 크기는 정확히 DISK_SECTOR_SIZE 바이트여야 한다.
+ * extent_* 필드는 익스텐트 형식(FAT_FEATURE_EXTENTS)으로 포맷한 경우에만 쓴다.
+ * 두 형식 모두 데이터 클러스터는 FAT 체인으로도 이어져 있으므로
+ * 빈 공간 관리와 해제는 같고, 오프셋 -> 클러스터 변환만 다르다.
+ * INODE_INLINE이 켜진 작은 파일은 클러스터 없이 같은 자리에 데이터를 둔다. */
 struct inode_disk
 {
-	cluster_t start; /* 첫 데이터 섹터. */
-	off_t length;	 /* 파일 크기(바이트). */
-	unsigned magic;	 /* 매직 넘버. */
+	cluster_t start;		/* 첫 데이터 클러스터. */
+	off_t length;			/* 파일 크기(바이트). */
+	unsigned magic;			/* 매직 넘버. */
 	bool isdir;
-	char unused[496];
+	uint8_t flags;			/* INODE_* 비트. */
+	uint16_t extent_cnt;	/* 사용 중인 익스텐트 수 (간접 블록 포함). */
+	union
+	{
+		struct
+		{
+			cluster_t extent_block; /* 간접 익스텐트 블록의 클러스터 (없으면 0). */
+			struct inode_extent extents[DIRECT_EXTENTS]; /* 직접 익스텐트. */
+			uint32_t unused;
+		};
+		uint8_t inline_data[INLINE_MAX]; /* INODE_INLINE: 파일 데이터. */
+	};
+};
+
+/* 간접 익스텐트 블록. 클러스터의 첫 섹터에 기록된다. */
+struct extent_block
+{
+	struct inode_extent extents[INDIRECT_EXTENTS];
+	uint32_t unused[2];
+};
+
+/* 메모리 상의 익스텐트. FIRST는 이 익스텐트가 덮는 첫 파일 클러스터 순번이다. */
+struct extent_map
+{
+	struct inode_extent ext;
+	uint32_t first;
 };
 
 /* 길이가 SIZE 바이트인 inode가 차지할 섹터 수를 반환한다. */
@@ -29,20 +88,81 @@ bytes_to_sectors(off_t size)
 	return DIV_ROUND_UP(size, DISK_SECTOR_SIZE);
 }
 
+/* 클러스터 하나의 크기(바이트)를 반환한다. */
+static inline off_t
+cluster_bytes(void)
+{
+	return fat_sectors_per_cluster() * DISK_SECTOR_SIZE;
+}
+
+/* 길이가 SIZE 바이트인 inode가 차지할 클러스터 수를 반환한다. */
+static inline size_t
+bytes_to_clusters(off_t size)
+{
+	return DIV_ROUND_UP(size, cluster_bytes());
+}
+
+/* 클러스터 CLST의 모든 섹터를 0으로 채운다. */
+static void
+zero_cluster(cluster_t clst)
+{
+	static uint8_t zeros[DISK_SECTOR_SIZE];
+	disk_sector_t sector = cluster_to_sector(clst);
+
+	for (unsigned i = 0; i < fat_sectors_per_cluster(); i++)
+		buffer_cache_write(sector + i, zeros);
+}
+
+/* 데이터가 inode 섹터 안에 있으면 true. */
+static inline bool
+is_inline(const struct inode_disk *data)
+{
+	return (data->flags & INODE_INLINE) != 0;
+}
+
 /* 메모리 상의 inode. */
 /* inode는 index node의 줄임말입니다.
 inode는 파일이나 디렉토리에 대한 메타데이터를 갖는 고유 식별자입니다.
 */
-struct inode
+/* open_inodes의 원소. 해시와 비교 함수는 이 필드만 읽으므로
+ * inode_open()은 찾을 때 struct inode 전체 대신 이것만 스택에 만든다. */
+struct inode_key
 {
-	struct list_elem elem;	/* inode 리스트의 요소. */
+	struct hash_elem elem;	/* open_inodes 해시 테이블의 요소. */
 	disk_sector_t sector;	/* 디스크 상 위치(섹터 번호). */
+};
+
+struct inode
+{
+	struct inode_key key;	/* open_inodes에서 찾는 열쇠. */
 	int open_cnt;			/* 열려 있는 횟수. */
 	bool removed;			/* 삭제된 경우 true. */
 	int deny_write_cnt;		/* 0이면 쓰기 허용, 0보다 크면 금지. */
+	cluster_t *clusters;	/* n번째 원소 = 파일의 n번째 클러스터 (지연 생성). */
+	size_t cluster_cnt;		/* clusters에 채워진 클러스터 수. */
+	size_t cluster_cap;		/* clusters 배열의 용량. */
+	struct extent_map *extents; /* 익스텐트 형식: 전체 익스텐트 목록 (지연 로드). */
+	size_t extent_cnt;		/* extents에 채워진 익스텐트 수. */
+	bool dirty;				/* data가 디스크의 inode와 다르면 true. */
+	struct rwlock rwlock;	/* 데이터와 data 필드 보호: 읽기는 공유, 쓰기와 확장은 배타. */
+	struct lock map_lock;	/* 읽는 쪽끼리 클러스터 인덱스/익스텐트 목록을 지연 생성할 때 쓴다. */
+	struct rwlock dir_lock; /* 디렉터리 이름 공간 보호 (directory.c). rwlock보다 먼저 잡는다. */
+	struct fat_reservation resv; /* 파일을 늘릴 때 쓸 예약 클러스터 창. fat.c가 alloc_lock 아래에서 고친다. */
 	struct inode_disk data; /* inode 내용. */
 };
 
+/* INODE의 메모리상 메타데이터가 바뀌었음을 표시한다. 나중에 inode_flush()로 기록된다.
+ * 이번 트랜잭션에서 처음 바뀌는 것이라면 inode 섹터 몫의 로그 블록 하나를 쓴다. */
+static void
+set_dirty(struct inode *inode)
+{
+	if (!inode->dirty)
+	{
+		inode->dirty = true;
+		journal_charge(inode->key.sector);
+	}
+}
+
 void create_root_dir_inode(void)
 {
 	// 1. 루트 디렉토리용 FAT 클러스터 하나 예약
@@ -50,11 +170,7 @@ void create_root_dir_inode(void)
 	fat_put(clst, EOChain);
 
 	// 2. 해당 클러스터 섹터를 0으로 초기화
-	uint8_t *zero_buf = calloc(1, DISK_SECTOR_SIZE);
-	if (zero_buf == NULL)
-		PANIC("create_root_dir_inode: OOM during zero padding");
-	disk_write(filesys_disk, cluster_to_sector(ROOT_DIR_CLUSTER), zero_buf);
-	free(zero_buf);
+	zero_cluster(ROOT_DIR_CLUSTER);
 
 	// 3. inode_disk 생성 및 설정
 	struct inode_disk root_inode;
@@ -64,57 +180,385 @@ void create_root_dir_inode(void)
 	root_inode.length = 0;				 // 초기에는 파일 크기 0
 	root_inode.magic = INODE_MAGIC;
 	root_inode.isdir = true;
+	if (fat_has_feature(FAT_FEATURE_EXTENTS))
+	{
+		root_inode.extent_cnt = 1;
+		root_inode.extents[0] = (struct inode_extent){ROOT_DIR_CLUSTER, 1};
+	}
 
 	// 4. 루트 inode를 디스크의 ROOT_DIR_SECTOR에 저장 (보통 sector 1)
-	disk_write(filesys_disk, ROOT_DIR_SECTOR, &root_inode);
+	buffer_cache_write_meta(ROOT_DIR_SECTOR, &root_inode);
+}
+
+/* INODE의 클러스터 인덱스 끝에 CLST를 추가한다.
+ * 메모리 할당에 실패하면 false를 반환한다. */
+static bool
+cluster_index_append(struct inode *inode, cluster_t clst)
+{
+	if (inode->cluster_cnt == inode->cluster_cap)
+	{
+		size_t new_cap = inode->cluster_cap == 0 ? 16 : inode->cluster_cap * 2;
+		cluster_t *new_clusters = realloc(inode->clusters, new_cap * sizeof *new_clusters);
+		if (new_clusters == NULL)
+			return false;
+		inode->clusters = new_clusters;
+		inode->cluster_cap = new_cap;
+	}
+	inode->clusters[inode->cluster_cnt++] = clst;
+	return true;
+}
+
+/* INODE의 클러스터 인덱스를 버린다. 필요하면 FAT에서 다시 만들어진다. */
+static void
+cluster_index_clear(struct inode *inode)
+{
+	free(inode->clusters);
+	inode->clusters = NULL;
+	inode->cluster_cnt = inode->cluster_cap = 0;
+}
+
+/* INODE의 클러스터 인덱스가 없다면 FAT 체인을 한 번 따라가며 만든다.
+ * 이후의 오프셋 -> 섹터 변환은 체인을 다시 걷지 않고 배열에서 바로 찾는다. */
+static bool
+cluster_index_build(struct inode *inode)
+{
+	if (inode->clusters != NULL)
+		return true;
+
+	cluster_t clst = inode->data.start;
+	while (clst != 0 && clst != EOChain)
+	{
+		if (!cluster_index_append(inode, clst))
+		{
+			cluster_index_clear(inode);
+			return false;
+		}
+		clst = fat_get(clst);
+	}
+	return true;
+}
+
+/* 체인에 새로 붙은 클러스터 CLST를 인덱스에도 반영한다.
+ * 인덱스가 아직 없다면 나중에 FAT에서 만들어지므로 아무것도 하지 않는다. */
+static void
+cluster_index_extend(struct inode *inode, cluster_t clst)
+{
+	if (clst == 0 || inode->clusters == NULL)
+		return;
+	if (!cluster_index_append(inode, clst))
+		cluster_index_clear(inode);
+}
+
+/* 익스텐트 형식으로 포맷된 파일 시스템이면 true. */
+static inline bool
+use_extents(void)
+{
+	return fat_has_feature(FAT_FEATURE_EXTENTS);
+}
+
+/* INODE의 익스텐트 목록을 버린다. */
+static void
+extent_clear(struct inode *inode)
+{
+	free(inode->extents);
+	inode->extents = NULL;
+	inode->extent_cnt = 0;
+}
+
+/* INODE의 익스텐트 목록이 메모리에 없다면 inode와 간접 블록에서 읽어 들이고,
+ * 익스텐트마다 파일 내 첫 클러스터 순번을 계산해 둔다. */
+static bool
+extent_load(struct inode *inode)
+{
+	if (inode->extents != NULL)
+		return true;
+
+	struct inode_disk *data = &inode->data;
+	struct extent_block *block = NULL;
+	inode->extents = malloc(MAX_EXTENTS * sizeof *inode->extents);
+	if (inode->extents == NULL)
+		return false;
+	if (data->extent_cnt > DIRECT_EXTENTS)
+	{
+		block = malloc(sizeof *block);
+		if (block == NULL)
+		{
+			extent_clear(inode);
+			return false;
+		}
+		buffer_cache_read(cluster_to_sector(data->extent_block), block);
+	}
+
+	uint32_t first = 0;
+	for (size_t i = 0; i < data->extent_cnt; i++)
+	{
+		struct extent_map *m = &inode->extents[i];
+		m->ext = i < DIRECT_EXTENTS ? data->extents[i] : block->extents[i - DIRECT_EXTENTS];
+		m->first = first;
+		first += m->ext.length;
+	}
+	inode->extent_cnt = data->extent_cnt;
+	free(block);
+	return true;
+}
+
+/* INODE의 IDX번째 클러스터를 익스텐트 목록에서 이진 탐색으로 찾는다.
+ * 없으면 0을 반환한다. */
+static cluster_t
+extent_lookup(struct inode *inode, size_t idx)
+{
+	size_t lo = 0, hi = inode->extent_cnt;
+
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		struct extent_map *m = &inode->extents[mid];
+		if (idx < m->first)
+			hi = mid;
+		else if (idx >= m->first + m->ext.length)
+			lo = mid + 1;
+		else
+			return m->ext.start + (idx - m->first);
+	}
+	return 0;
+}
+
+/* INODE의 익스텐트 목록 끝에 클러스터 CLST를 붙인다.
+ * 마지막 익스텐트 바로 뒤라면 그 익스텐트를 늘리고, 아니면 새 익스텐트를 만든다.
+ * 익스텐트가 MAX_EXTENTS개를 넘게 되면 false를 반환한다. */
+static bool
+extent_append(struct inode *inode, cluster_t clst)
+{
+	uint32_t first = 0;
+
+	if (inode->extent_cnt > 0)
+	{
+		struct extent_map *last = &inode->extents[inode->extent_cnt - 1];
+		if (last->ext.start + last->ext.length == clst)
+		{
+			last->ext.length++;
+			return true;
+		}
+		if (inode->extent_cnt == MAX_EXTENTS)
+			return false;
+		first = last->first + last->ext.length;
+	}
+	inode->extents[inode->extent_cnt++] = (struct extent_map){{clst, 1}, first};
+	return true;
+}
+
+/* INODE의 익스텐트 목록을 inode_disk와 간접 익스텐트 블록에 반영한다.
+ * inode 섹터 자체는 inode를 dirty로 표시해 두면 나중에 inode_flush()로 기록된다.
+ * 간접 블록이나 메모리를 얻지 못하면 inode_disk를 건드리지 않고 false를 반환한다. */
+static bool
+extent_store(struct inode *inode)
+{
+	struct inode_disk *data = &inode->data;
+	size_t cnt = inode->extent_cnt;
+
+	if (cnt > DIRECT_EXTENTS)
+	{
+		struct extent_block *block = calloc(1, sizeof *block);
+		if (block == NULL)
+			return false;
+		if (data->extent_block == 0)
+		{
+			data->extent_block = fat_extend_chain(0, 1);
+			if (data->extent_block == 0)
+			{
+				free(block);
+				return false;
+			}
+		}
+		for (size_t i = DIRECT_EXTENTS; i < cnt; i++)
+			block->extents[i - DIRECT_EXTENTS] = inode->extents[i].ext;
+		buffer_cache_write_meta(cluster_to_sector(data->extent_block), block);
+		free(block);
+	}
+
+	for (size_t i = 0; i < cnt && i < DIRECT_EXTENTS; i++)
+		data->extents[i] = inode->extents[i].ext;
+	data->extent_cnt = cnt;
+	return true;
+}
+
+/* 체인에 새로 붙은 CLST부터 CNT개의 클러스터를 INODE의 익스텐트 목록에 붙이고 기록한다.
+ * 실패하면 익스텐트 목록을 호출 전 상태로 되돌리고 false를 반환한다. */
+static bool
+extent_grow(struct inode *inode, cluster_t clst, size_t cnt)
+{
+	size_t old_cnt = inode->extent_cnt;
+	uint32_t old_len = old_cnt > 0 ? inode->extents[old_cnt - 1].ext.length : 0;
+
+	for (size_t i = 0; i < cnt; i++)
+	{
+		if (!extent_append(inode, clst))
+			goto fail;
+		clst = fat_get(clst);
+	}
+	if (extent_store(inode))
+		return true;
+
+fail:
+	inode->extent_cnt = old_cnt;
+	if (old_cnt > 0)
+		inode->extents[old_cnt - 1].ext.length = old_len;
+	return false;
+}
+
+/* INODE의 오프셋 -> 클러스터 변환 자료(익스텐트 목록 또는 클러스터 인덱스)를 준비한다. */
+static bool
+map_load(struct inode *inode)
+{
+	return use_extents() ? extent_load(inode) : cluster_index_build(inode);
+}
+
+/* INODE에 할당된 클러스터 수를 반환한다. map_load() 이후에만 호출한다. */
+static size_t
+map_count(struct inode *inode)
+{
+	if (!use_extents())
+		return inode->cluster_cnt;
+	if (inode->extent_cnt == 0)
+		return 0;
+	struct extent_map *last = &inode->extents[inode->extent_cnt - 1];
+	return last->first + last->ext.length;
+}
+
+/* INODE의 IDX번째 클러스터를 반환한다. 없으면 0. map_load() 이후에만 호출한다. */
+static cluster_t
+map_get(struct inode *inode, size_t idx)
+{
+	if (use_extents())
+		return extent_lookup(inode, idx);
+	return idx < inode->cluster_cnt ? inode->clusters[idx] : 0;
 }
 
 /* INODE의 바이트 오프셋 POS가 위치한 디스크 섹터를 반환한다.
  * POS 위치에 데이터가 없으면 -1을 반환한다. */
 static disk_sector_t
-byte_to_sector(const struct inode *inode, off_t pos)
+byte_to_sector(struct inode *inode, off_t pos)
 {
 	ASSERT(inode != NULL);
 
-	if (pos > inode->data.length)
+	if (pos > inode->data.length || is_inline(&inode->data))
 		return -1;
 
-	// pos 오프셋이 위치한 섹터 서치
-	off_t sectors = pos / DISK_SECTOR_SIZE;
-	// 체인의 시작점 확보
-	/**
-	 * inode->data.start = 이 파일의 첫번째 섹터 번호
-	 */
-	cluster_t clst_idx = inode->data.start;
-	if (clst_idx == 0 || clst_idx == EOChain)
+	/* 클러스터 인덱스나 익스텐트 목록에서 pos가 위치한 클러스터를 찾고,
+	 * 클러스터 안에서의 섹터 위치를 더한다. */
+	if (!map_load(inode))
 		return -1;
+	cluster_t clst = map_get(inode, pos / cluster_bytes());
+	if (clst == 0)
+		return -1;
+
+	return cluster_to_sector(clst) + (pos % cluster_bytes()) / DISK_SECTOR_SIZE;
+}
+
+/* SECTOR가 아직 기록되지 않은 클러스터에 속하면 true. 그 내용은 0으로 본다. */
+static bool
+is_hole(disk_sector_t sector)
+{
+	return fat_is_unwritten(sector_to_cluster(sector));
+}
+
+/* SECTOR에 쓰기 직전에 호출한다. SECTOR가 속한 클러스터가 아직 기록된 적 없다면
+ * 버퍼 캐시 안에서만 0으로 채우고(디스크 읽기 없음) 표시를 지운다. */
+static void
+prepare_write(disk_sector_t sector)
+{
+	cluster_t clst = sector_to_cluster(sector);
+	if (fat_is_unwritten(clst))
+	{
+		zero_cluster(clst);
+		fat_set_unwritten(clst, false);
+	}
+}
+
+/* 섹터 경계인 OFFSET부터 SIZE 바이트 안에서, 파일 안에 온전히 들어 있고
+ * 디스크상으로도 이어져 있는 기록된 섹터의 수를 READ_RUN_MAX개까지 센다. */
+static size_t
+sector_run(struct inode *inode, off_t offset, off_t size)
+{
+	off_t limit = inode_length(inode) - offset;
+	if (size < limit)
+		limit = size;
 
-	// pos가 위치한 섹터의 fat인덱스 찾기
-	/* 체인을 따라가면서 저장될 위치를 찾음 */
-	while (sectors > 0)
+	disk_sector_t first = byte_to_sector(inode, offset);
+	size_t cnt = 0;
+	while (cnt < READ_RUN_MAX && (off_t)(cnt + 1) * DISK_SECTOR_SIZE <= limit)
 	{
-		clst_idx = fat_get(clst_idx);
-		if (clst_idx == EOChain)
-			return -1;
-		sectors--;
+		disk_sector_t sector = byte_to_sector(inode, offset + cnt * DISK_SECTOR_SIZE);
+		if (sector != first + cnt || is_hole(sector))
+			break;
+		cnt++;
 	}
+	return cnt;
+}
 
-	return cluster_to_sector(clst_idx);
+/* 방금 만든 SECTOR의 inode에 START부터 CNT개 클러스터의 익스텐트 목록을 기록한다. */
+static bool
+extent_init(disk_sector_t sector, cluster_t start, size_t cnt)
+{
+	struct inode *inode = inode_open(sector);
+	if (inode == NULL)
+		return false;
+
+	bool success = extent_load(inode) && extent_grow(inode, start, cnt);
+	if (success)
+		inode_flush(inode);
+	inode_close(inode);
+	return success;
 }
 
 /* 동일한 inode를 두 번 열 때 같은 `struct inode'를 반환하기 위한
- * 열린 inode 목록. */
-static struct list open_inodes;
+ * 열린 inode 테이블. 섹터 번호를 키로 하는 해시 테이블이다. */
+static struct hash open_inodes;
+
+/* open_inodes를 보호하는 락. 플러시 스레드도 테이블을 순회한다. */
+static struct lock open_inodes_lock;
+
+/* 연산 안에서 해제할 로그 자리를 예약하지 못해 미뤄 둔 클러스터 체인.
+ * 플러시 스레드가 연산 밖에서 inode_release_deferred()로 해제한다. */
+struct deferred_chain
+{
+	struct list_elem elem;
+	cluster_t clst; /* 체인의 첫 클러스터. */
+};
+static struct list deferred_chains;
+static struct lock deferred_lock;
+
+static uint64_t open_inode_hash(const struct hash_elem *e, void *aux UNUSED);
+static bool open_inode_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED);
 
 /* inode 모듈을 초기화한다. */
 void inode_init(void)
 {
-	list_init(&open_inodes);
+	if (!hash_init(&open_inodes, open_inode_hash, open_inode_less, NULL))
+		PANIC("inode table init failed");
+	lock_init(&open_inodes_lock);
+	list_init(&deferred_chains);
+	lock_init(&deferred_lock);
+}
+
+/* open_inodes의 해시 함수: inode의 섹터 번호. */
+static uint64_t
+open_inode_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	return hash_int(hash_entry(e, struct inode_key, elem)->sector);
+}
+
+/* open_inodes의 비교 함수: 섹터 번호 순. */
+static bool
+open_inode_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+	return hash_entry(a, struct inode_key, elem)->sector < hash_entry(b, struct inode_key, elem)->sector;
 }
 
 /* 길이가 LENGTH 바이트인 데이터를 갖는 inode를 초기화하여
  * 파일 시스템 디스크의 SECTOR 섹터에 기록한다.
- * 성공하면 true를, 메모리나 디스크 할당이 실패하면 false를 반환한다. */
+ * 성공하면 true를, 메모리나 디스크 할당이 실패하면 false를 반환한다.
+ * 한 트랜잭션으로 만들므로 LENGTH가 INODE_CREATE_MAX보다 크면 로그에 담기지 않아 실패할 수 있다. */
 bool inode_create(disk_sector_t sector, off_t length, bool is_dir)
 {
 	struct inode_disk *disk_inode = NULL;
@@ -126,28 +570,42 @@ bool inode_create(disk_sector_t sector, off_t length, bool is_dir)
 	 * 정확히 일치하지 않는 것이므로 수정해야 한다. */
 	ASSERT(sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+	if (!journal_begin(bytes_to_clusters(length) + 4))
+		return false;
 	disk_inode = calloc(1, sizeof *disk_inode);
 	if (disk_inode != NULL)
 	{
-		size_t sectors = bytes_to_sectors(length);
+		size_t clusters = bytes_to_clusters(length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
 		disk_inode->isdir = is_dir;
-		if (fat_allocate(sectors, &disk_inode->start))
+		if (length <= INLINE_MAX)
 		{
-			disk_write(filesys_disk, sector, disk_inode);
-			if (sectors > 0)
-			{
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
+			/* 작은 파일은 클러스터를 할당하지 않고 inode 섹터에 데이터를 둔다.
+			 * inline_data는 calloc으로 이미 0이다. */
+			disk_inode->flags = INODE_INLINE;
+			buffer_cache_write_meta(sector, disk_inode);
+			success = true;
+		}
+		else if (fat_allocate_near(clusters, fat_hint(sector), &disk_inode->start))
+		{
+			buffer_cache_write_meta(sector, disk_inode);
 
-				for (i = 0; i < sectors; i++)
-					disk_write(filesys_disk, cluster_to_sector(disk_inode->start) + i, zeros);
+			/* 새 클러스터는 0을 기록하는 대신 아직 기록되지 않았다고 표시만 한다.
+			 * 체인이 연속이 아닐 수 있으므로 FAT을 따라간다. */
+			cluster_t clst = disk_inode->start;
+			for (size_t i = 0; i < clusters; i++)
+			{
+				fat_set_unwritten(clst, true);
+				clst = fat_get(clst);
 			}
-			success = true;
+			success = !use_extents() || clusters == 0 || extent_init(sector, disk_inode->start, clusters);
+			if (!success)
+				fat_release(disk_inode->start);
 		}
 		free(disk_inode);
 	}
+	journal_end();
 
 	return success;
 }
@@ -157,33 +615,48 @@ bool inode_create(disk_sector_t sector, off_t length, bool is_dir)
 struct inode *
 inode_open(disk_sector_t sector)
 {
-	struct list_elem *e;
+	struct hash_elem *e;
 	struct inode *inode;
+	struct inode_key key;
+
+	lock_acquire(&open_inodes_lock);
 
 	/* 이미 열려 있는 inode인지 확인한다. */
-	for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
-		 e = list_next(e))
+	key.sector = sector;
+	e = hash_find(&open_inodes, &key.elem);
+	if (e != NULL)
 	{
-		inode = list_entry(e, struct inode, elem);
-		if (inode->sector == sector)
-		{
-			inode_reopen(inode);
-			return inode;
-		}
+		inode = hash_entry(e, struct inode, key.elem);
+		inode->open_cnt++;
+		lock_release(&open_inodes_lock);
+		return inode;
 	}
 
 	/* 메모리를 할당한다. */
 	inode = malloc(sizeof *inode);
 	if (inode == NULL)
+	{
+		lock_release(&open_inodes_lock);
 		return NULL;
+	}
 
 	/* 초기화. */
-	list_push_front(&open_inodes, &inode->elem);
-	inode->sector = sector;
+	inode->key.sector = sector;
+	hash_insert(&open_inodes, &inode->key.elem);
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read(filesys_disk, inode->sector, &inode->data);
+	inode->clusters = NULL;
+	inode->cluster_cnt = inode->cluster_cap = 0;
+	inode->extents = NULL;
+	inode->extent_cnt = 0;
+	inode->dirty = false;
+	inode->resv.cnt = 0;
+	rw_init(&inode->rwlock);
+	lock_init(&inode->map_lock);
+	rw_init(&inode->dir_lock);
+	buffer_cache_read(inode->key.sector, &inode->data);
+	lock_release(&open_inodes_lock);
 	return inode;
 }
 
@@ -192,7 +665,11 @@ struct inode *
 inode_reopen(struct inode *inode)
 {
 	if (inode != NULL)
+	{
+		lock_acquire(&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release(&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -200,7 +677,91 @@ inode_reopen(struct inode *inode)
 disk_sector_t
 inode_get_inumber(const struct inode *inode)
 {
-	return inode->sector;
+	return inode->key.sector;
+}
+
+/* release_chain()이 트랜잭션 하나에서 해제하는 체인이 바꾸는 FAT 섹터 수의 상한. */
+#define RELEASE_SECTORS 32
+
+/* CLST부터의 체인을 나중에 inode_release_deferred()가 해제하도록 미뤄 둔다.
+ * 메모리가 없으면 체인이 새므로 알린다. */
+static void
+defer_release(cluster_t clst)
+{
+	struct deferred_chain *d = malloc(sizeof *d);
+	if (d == NULL)
+	{
+		printf("inode: leaking cluster chain at %u\n", (unsigned)clst);
+		return;
+	}
+	d->clst = clst;
+	lock_acquire(&deferred_lock);
+	list_push_back(&deferred_chains, &d->elem);
+	lock_release(&deferred_lock);
+}
+
+/* 더 이상 아무도 가리키지 않는 CLST부터의 체인을 해제한다.
+ * 큰 체인은 FAT 섹터 RELEASE_SECTORS개씩 나누어 여러 트랜잭션으로 해제한다.
+ * 바깥 연산 안이라 로그 자리를 더 받지 못하면 남은 체인은 defer_release()로 미룬다. */
+static void
+release_chain(cluster_t clst)
+{
+	while (clst != 0)
+	{
+		if (!journal_begin(RELEASE_SECTORS))
+		{
+			defer_release(clst);
+			return;
+		}
+		clst = fat_release_bounded(clst, RELEASE_SECTORS);
+		journal_end();
+	}
+}
+
+/* 미뤄 둔 체인을 모두 해제한다. 연산 밖에서 불러야 한다. */
+void inode_release_deferred(void)
+{
+	struct list chains;
+
+	ASSERT(!journal_in_op());
+	list_init(&chains);
+	lock_acquire(&deferred_lock);
+	while (!list_empty(&deferred_chains))
+		list_push_back(&chains, list_pop_front(&deferred_chains));
+	lock_release(&deferred_lock);
+
+	while (!list_empty(&chains))
+	{
+		struct deferred_chain *d = list_entry(list_pop_front(&chains), struct deferred_chain, elem);
+		release_chain(d->clst);
+		free(d);
+	}
+}
+
+/* 삭제된 INODE의 블록을 반환한다. 디렉터리 엔트리는 이미 지워졌으므로
+ * 데이터 체인부터 release_chain()으로 풀고, 익스텐트 블록과 inode 클러스터는 마지막에 푼다. */
+static void
+inode_release(struct inode *inode)
+{
+#ifdef EFILESYS
+	if (!is_inline(&inode->data))
+		release_chain(inode->data.start);
+	if (!journal_begin(2))
+	{
+		if (!is_inline(&inode->data) && inode->data.extent_block != 0)
+			defer_release(inode->data.extent_block);
+		defer_release(sector_to_cluster(inode->key.sector));
+		return;
+	}
+	if (!is_inline(&inode->data) && inode->data.extent_block != 0)
+		fat_release(inode->data.extent_block);
+	fat_release(sector_to_cluster(inode->key.sector));
+	journal_end();
+#else
+	free_map_release(inode->key.sector, 1);
+	free_map_release(inode->data.start,
+					 bytes_to_sectors(inode->data.length));
+#endif
 }
 
 /* INODE을 닫고 디스크에 기록한다.
@@ -215,25 +776,28 @@ void inode_close(struct inode *inode)
 	if (inode->data.magic != INODE_MAGIC)
 		return;
 
-	/* 마지막으로 열려 있다면 자원을 해제한다. */
-	if (--inode->open_cnt == 0)
+	/* 마지막으로 열려 있다면 자원을 해제한다.
+	 * 미뤄 둔 메타데이터는 테이블에서 빼기 전에 기록해야
+	 * 곧바로 같은 섹터를 여는 스레드가 옛 내용을 읽지 않는다. 삭제될 inode라면 필요 없다. */
+	lock_acquire(&open_inodes_lock);
+	bool last = --inode->open_cnt == 0;
+	if (last)
 	{
-		/* 리스트에서 제거하고 잠금을 해제한다. */
-		list_remove(&inode->elem);
+		if (inode->dirty && !inode->removed)
+			inode_flush(inode);
+		hash_delete(&open_inodes, &inode->key.elem);
+	}
+	lock_release(&open_inodes_lock);
 
+	if (last)
+	{
 		/* 삭제된 경우 블록을 반환한다. */
 		if (inode->removed)
-		{
-#ifdef EFILESYS
-			fat_release(inode->data.start);
-			fat_release(sector_to_cluster(inode->sector));
-#else
-			free_map_release(inode->sector, 1);
-			free_map_release(inode->data.start,
-							 bytes_to_sectors(inode->data.length));
-#endif
-		}
+			inode_release(inode);
 
+		fat_unreserve(&inode->resv);
+		cluster_index_clear(inode);
+		extent_clear(inode);
 		free(inode);
 	}
 }
@@ -245,22 +809,76 @@ void inode_remove(struct inode *inode)
 	inode->removed = true;
 }
 
+/* 읽는 쪽이 rwlock을 공유한 채 byte_to_sector()를 쓸 수 있도록
+ * 클러스터 인덱스나 익스텐트 목록을 map_lock 아래에서 미리 만들어 둔다.
+ * 한 번 만들어진 목록은 rwlock을 배타로 잡은 쓰는 쪽만 고친다. */
+static void
+map_prepare(struct inode *inode)
+{
+	if (is_inline(&inode->data))
+		return;
+	lock_acquire(&inode->map_lock);
+	map_load(inode);
+	lock_release(&inode->map_lock);
+}
+
+static off_t read_at_locked(struct inode *, void *, off_t, off_t);
+static off_t write_at_locked(struct inode *, const void *, off_t, off_t);
+
 /* OFFSET 위치부터 INODE에서 SIZE 바이트를 BUFFER로 읽어 들인다.
  * 오류가 발생하거나 파일 끝에 도달하면 SIZE보다 적게 읽을 수 있으며,
- * 실제로 읽은 바이트 수를 반환한다. */
-off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
+ * 실제로 읽은 바이트 수를 반환한다. 같은 inode를 읽는 스레드끼리는 동시에 진행한다. */
+off_t inode_read_at(struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+	rw_read_acquire(&inode->rwlock);
+	map_prepare(inode);
+	off_t bytes_read = read_at_locked(inode, buffer, size, offset);
+	rw_read_release(&inode->rwlock);
+	return bytes_read;
+}
+
+/* inode_read_at()의 본체. rwlock을 잡고 호출해야 한다. */
+static off_t
+read_at_locked(struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
 
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
+	/* inline 파일은 이미 메모리에 있는 inode에서 바로 복사한다. */
+	if (is_inline(&inode->data))
+	{
+		if (offset >= inode_length(inode) || size <= 0)
+			return 0;
+		if (size > inode_length(inode) - offset)
+			size = inode_length(inode) - offset;
+		memcpy(buffer, inode->data.inline_data + offset, size);
+		return size;
+	}
+
+	uint8_t *run_buffer = NULL;
 	while (size > 0)
 	{
 		/* 읽을 디스크 섹터와 섹터 내 시작 오프셋. */
 		disk_sector_t sector_idx = byte_to_sector(inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
+		/* 섹터 경계에서 시작해 여러 섹터를 통째로 읽는다면
+		 * 디스크상 연속된 구간을 한 번에 읽는다. */
+		size_t run = sector_ofs == 0 ? sector_run(inode, offset, size) : 0;
+		if (run > 1 && run_buffer == NULL)
+			run_buffer = malloc(READ_RUN_MAX * DISK_SECTOR_SIZE);
+		if (run > 1 && run_buffer != NULL)
+		{
+			off_t run_bytes = run * DISK_SECTOR_SIZE;
+			buffer_cache_read_multi(sector_idx, run, run_buffer);
+			memcpy(buffer + bytes_read, run_buffer, run_bytes);
+			size -= run_bytes;
+			offset += run_bytes;
+			bytes_read += run_bytes;
+			continue;
+		}
+
 		/* inode와 섹터에 남은 바이트 중 더 작은 값. */
 		off_t inode_left = inode_length(inode) - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
@@ -271,79 +889,267 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE)
-		{
-			/* 섹터 전체를 호출자의 버퍼로 직접 읽는다. */
-			disk_read(filesys_disk, sector_idx, buffer + bytes_read);
-		}
+		/* 아직 기록되지 않은 클러스터는 디스크를 읽지 않고 0으로 채우고,
+		 * 나머지는 버퍼 캐시를 거쳐 필요한 부분만 호출자의 버퍼로 복사한다. */
+		if (is_hole(sector_idx))
+			memset(buffer + bytes_read, 0, chunk_size);
 		else
-		{
-			/* 섹터를 bounce 버퍼에 읽은 뒤 일부를 호출자의 버퍼에 복사한다. */
-			if (bounce == NULL)
-			{
-				bounce = malloc(DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read(filesys_disk, sector_idx, bounce);
-			memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+			buffer_cache_read_at(sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
 
 		/* 진행. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free(bounce);
+	free(run_buffer);
 
 	return bytes_read;
 }
 
+/* INODE를 POS 위치까지 순차적으로 읽었을 때 호출한다.
+ * POS 이후 READAHEAD_SECTORS개 섹터 중 REQUESTED 앞쪽은 이미 요청했다고 보고 건너뛰며,
+ * 나머지를 워커 데몬이 미리 버퍼 캐시로 읽어 두도록 요청한다.
+ * 새로 요청한 끝 위치를 반환하며, 호출자가 다음 호출의 REQUESTED로 넘긴다. */
+off_t inode_readahead(struct inode *inode, off_t pos, off_t requested)
+{
+	rw_read_acquire(&inode->rwlock);
+	map_prepare(inode);
+
+	off_t end = pos + READAHEAD_SECTORS * DISK_SECTOR_SIZE;
+	if (end > inode_length(inode))
+		end = inode_length(inode);
+
+	off_t ofs = ROUND_UP(pos, DISK_SECTOR_SIZE);
+	if (ofs < requested)
+		ofs = requested;
+
+	for (; ofs < end; ofs += DISK_SECTOR_SIZE)
+	{
+		disk_sector_t sector = byte_to_sector(inode, ofs);
+		if (sector == (disk_sector_t)-1)
+			break;
+		if (!is_hole(sector))
+			buffer_cache_readahead(sector);
+	}
+	rw_read_release(&inode->rwlock);
+	return ofs > requested ? ofs : requested;
+}
+
+/* INODE가 LENGTH 바이트를 담을 수 있도록 클러스터 체인을 늘리고 길이를 갱신한다.
+ * 체인의 마지막 클러스터는 클러스터 인덱스나 익스텐트 목록에서 바로 얻으므로
+ * 체인을 걷지 않으며, 모자란 클러스터는 fat_extend_chain()으로 한 번에 할당한다.
+ * 새 클러스터는 디스크에 0을 쓰지 않고 FAT_UNWRITTEN으로 표시해 두며,
+ * 읽으면 0으로 보이고 처음 쓸 때 채워진다. 할당에 실패하면 false를 반환한다. */
+static bool
+inode_extend(struct inode *inode, off_t length)
+{
+	if (!map_load(inode))
+		return false;
+
+	size_t have = map_count(inode);
+	size_t need = bytes_to_clusters(length);
+	if (need > have)
+	{
+		size_t cnt = need - have;
+		cluster_t tail = have > 0 ? map_get(inode, have - 1) : 0;
+		cluster_t goal = tail != 0 ? tail + 1 : fat_hint(inode->key.sector);
+		cluster_t clst = fat_extend_reserved(tail, cnt, goal, &inode->resv);
+		if (clst == 0)
+			return false;
+		if (use_extents() && !extent_grow(inode, clst, cnt))
+		{
+			fat_remove_chain(clst, tail);
+			return false;
+		}
+		if (inode->data.start == 0)
+			inode->data.start = clst;
+
+		for (size_t i = 0; i < cnt; i++)
+		{
+			if (!use_extents())
+				cluster_index_extend(inode, clst);
+			fat_set_unwritten(clst, true);
+			clst = fat_get(clst);
+		}
+	}
+	inode->data.length = length;
+	set_dirty(inode);
+	return true;
+}
+
+/* INODE의 데이터 섹터 SECTOR의 OFS 위치에 BUFFER의 SIZE 바이트를 버퍼 캐시로 기록한다.
+ * 디렉터리 내용은 메타데이터이므로 저널을 거친다. */
+static void
+data_write_at(struct inode *inode, disk_sector_t sector, const void *buffer,
+			  off_t size, off_t ofs)
+{
+	if (inode->data.isdir)
+		buffer_cache_write_meta_at(sector, buffer, size, ofs);
+	else
+		buffer_cache_write_at(sector, buffer, size, ofs);
+}
+
+/* inline 파일 INODE를 클러스터를 쓰는 보통 파일로 바꾼다.
+ * inode 섹터에 있던 데이터는 새로 할당한 첫 클러스터로 옮긴다.
+ * 할당에 실패하면 inode를 그대로 두고 false를 반환한다. */
+static bool
+inode_promote(struct inode *inode)
+{
+	struct inode_disk *data = &inode->data;
+	off_t length = data->length;
+	uint8_t *saved = malloc(INLINE_MAX);
+	if (saved == NULL)
+		return false;
+	memcpy(saved, data->inline_data, INLINE_MAX);
+
+	/* inline_data 자리를 익스텐트 필드로 다시 쓰므로 0으로 비운다. */
+	memset(data->inline_data, 0, INLINE_MAX);
+	data->flags &= ~INODE_INLINE;
+	data->length = 0;
+	if (!inode_extend(inode, length))
+	{
+		memcpy(data->inline_data, saved, INLINE_MAX);
+		data->flags |= INODE_INLINE;
+		data->length = length;
+		free(saved);
+		return false;
+	}
+
+	if (length > 0)
+	{
+		disk_sector_t sector = byte_to_sector(inode, 0);
+		prepare_write(sector);
+		data_write_at(inode, sector, saved, length, 0);
+	}
+	free(saved);
+	return true;
+}
+
+/* OFFSET부터 WRITE_CHUNK 바이트 이하를 쓰는 트랜잭션 하나가 새로 더럽힐 수 있는
+ * 메타데이터 섹터 수의 상한. 걸치는 섹터마다 새 클러스터의 FAT 섹터 하나(디렉터리는
+ * 데이터 섹터도 하나)와 꼬리 클러스터의 FAT 섹터, inode 섹터, 간접 익스텐트 블록과
+ * 그 클러스터의 FAT 섹터를 센다. */
+static size_t
+chunk_credits(const struct inode *inode, off_t size, off_t offset)
+{
+	size_t sectors = DIV_ROUND_UP(offset % DISK_SECTOR_SIZE + size, DISK_SECTOR_SIZE);
+	return (inode->data.isdir ? 3 : 2) * sectors + 4;
+}
+
+/* OFFSET부터 SIZE 바이트를 inode_write_at()으로 쓸 때 필요한 로그 블록 수.
+ * 파일 끝 너머의 빈 구간을 늘리는 몫까지 inode_write_at()과 같은 방식으로 센다.
+ * 바깥 트랜잭션 안에서 쓰는 호출자가 미리 예약할 때 쓴다. */
+size_t
+inode_write_credits(const struct inode *inode, off_t size, off_t offset)
+{
+	size_t credits = 0;
+
+	for (off_t length = inode_length(inode); length < offset; length += WRITE_CHUNK)
+		credits += chunk_credits(inode, WRITE_CHUNK, offset);
+	do
+	{
+		off_t chunk = size < WRITE_CHUNK ? size : WRITE_CHUNK;
+		credits += chunk_credits(inode, chunk, offset);
+		size -= chunk;
+		offset += chunk;
+	} while (size > 0);
+	return credits;
+}
+
 /* OFFSET 위치부터 BUFFER의 데이터를 SIZE 바이트 만큼 INODE에 기록한다.
  * 파일 끝에 도달하거나 오류가 발생하면 SIZE보다 적게 쓸 수 있으며,
  * 실제로 기록한 바이트 수를 반환한다.
- * (보통 파일 끝에서의 쓰기는 inode를 확장해야 하지만, 아직 구현되지 않았다.) */
+ * 쓰기와 확장은 같은 inode의 다른 읽기/쓰기와 배타적으로 진행한다.
+ * 한 트랜잭션이 로그를 넘지 않도록 WRITE_CHUNK 바이트씩 나누어 쓰며,
+ * 파일 끝 너머에서 시작하는 쓰기는 그 사이의 빈 구간부터 같은 크기씩 늘린다. */
 off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
 					 off_t offset)
 {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-
-	if (inode->deny_write_cnt)
-		return 0;
+	bool retried = false;
 
-	/** TODO: 여기서 파일 확장을 구현해야 함
-	 * 오프셋 + 사이즈가 파일 끝보다 크다면 그만큼 섹터를 확장
-	 * 클러스터 체인에도 붙여야함
-	 * 확장 이후엔 while 루프에 진입해서 확장된 섹터에 write
-	 */
-	off_t cur_len = inode_length(inode);
-	off_t extend_size = offset + size;
-	if (extend_size > inode_length(inode)) // 파일 끝보다 크게 써야 한다면
+	/* 길이는 줄지 않으므로 잠그기 전에 본 빈 구간이 잠근 뒤에 새로 생기지는 않는다. */
+	while (size > 0 || offset > inode_length(inode))
 	{
-		off_t last_sector_use_size = inode_length(inode) % DISK_SECTOR_SIZE; // 마지막 섹터의 사용 공간
-		off_t remain_length = extend_size - inode_length(inode);			 // 확장해야할 크기 찾기
-		off_t last_sector_remain_size = DISK_SECTOR_SIZE - last_sector_use_size;
+		bool gap = offset > inode_length(inode);
+		off_t chunk = gap || size > WRITE_CHUNK ? WRITE_CHUNK : size;
+		if (!journal_begin(chunk_credits(inode, chunk, offset)))
+			break;
+		rw_write_acquire(&inode->rwlock);
+
+		bool progress;
+		off_t length = inode_length(inode);
+		if (offset > length)
+		{
+			/* 빈 구간은 데이터 없이 길이만 늘린다. */
+			off_t target = offset - length > WRITE_CHUNK ? length + WRITE_CHUNK : offset;
+			write_at_locked(inode, NULL, 0, target);
+			progress = inode_length(inode) == target;
+		}
+		else
+		{
+			chunk = size > WRITE_CHUNK ? WRITE_CHUNK : size;
+			off_t done = write_at_locked(inode, buffer + bytes_written, chunk, offset);
+			size -= done;
+			offset += done;
+			bytes_written += done;
+			progress = done == chunk;
+		}
 
-		if (inode->data.start == 0) // 현재 할당받은 클러스터 아무것도 없음
-			inode->data.start = fat_create_chain(0);
+		rw_write_release(&inode->rwlock);
+		journal_end();
+		if (!progress)
+		{
+			/* 해제한 클러스터는 커밋된 뒤에야 다시 쓸 수 있다. 그 때문에 모자랐을 수 있으면
+			 * 한 번 커밋하고 다시 시도한다. 바깥 연산 안이라면 커밋을 기다릴 수 없다. */
+			if (retried || journal_in_op() || !fat_has_pending_frees())
+				break;
+			retried = true;
+			filesys_sync();
+		}
+	}
+	return bytes_written;
+}
 
-		inode->data.length += remain_length < last_sector_remain_size ? remain_length : last_sector_remain_size;
-		remain_length -= last_sector_remain_size;
+/* INODE를 LENGTH 바이트까지 늘린다. 늘어난 부분은 0으로 읽힌다.
+ * inode_create()가 한 번에 만들 수 없는 큰 파일을 만들 때 쓴다. */
+bool inode_grow(struct inode *inode, off_t length)
+{
+	inode_write_at(inode, NULL, 0, length);
+	return inode_length(inode) >= length;
+}
+
+/* inode_write_at()의 본체. rwlock을 배타로 잡고 호출해야 한다. */
+static off_t
+write_at_locked(struct inode *inode, const void *buffer_, off_t size,
+				off_t offset)
+{
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
 
-		while (remain_length > 0)
+	if (inode->deny_write_cnt)
+		return 0;
+
+	if (is_inline(&inode->data))
+	{
+		/* inline 영역 안에서 끝나는 쓰기는 inode만 고치면 된다. */
+		if (offset + size <= INLINE_MAX)
 		{
-			cluster_t new_clst = fat_create_chain(inode->data.start); // 클러스터 확장
-			off_t add_size = remain_length < DISK_SECTOR_SIZE ? remain_length : DISK_SECTOR_SIZE;
-			inode->data.length += add_size;				  // 이 파일의 길이를 확장
-			remain_length -= DISK_SECTOR_SIZE;			  // 남은 길이 - 512
-			uint8_t zero_pad_buf[DISK_SECTOR_SIZE] = {0}; // 512 바이트 0 패딩 버퍼
-			disk_sector_t new_sector = cluster_to_sector(new_clst);
-			disk_write(filesys_disk, new_sector, zero_pad_buf);
+			memcpy(inode->data.inline_data + offset, buffer, size);
+			if (offset + size > inode_length(inode))
+				inode->data.length = offset + size;
+			set_dirty(inode);
+			return size;
 		}
+		if (!inode_promote(inode))
+			return 0;
 	}
 
+	/* 파일 끝을 넘어 써야 한다면 먼저 파일을 확장한다. */
+	if (offset + size > inode_length(inode) && !inode_extend(inode, offset + size))
+		return 0;
+
 	while (size > 0)
 	{
 		/* 기록할 섹터와 섹터 내 시작 오프셋. */
@@ -366,58 +1172,131 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)								// 이번에 쓸 바이트가 0 이하라면 탈출
 			break;
 
-		/* 섹터 전체 (512B)를 쓸 수 있는 경우라면 */
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE)
-		{
-			/* 섹터 전체를 디스크에 바로 기록한다. */
-			/**
-			 * filesys_disk = 파일 시스템 디스크
-			 * sector_idx = 기록될 섹터 번호
-			 * buffer + bytes_written = 데이터를 가져올 버퍼 주소
-			 */
-			disk_write(filesys_disk, sector_idx, buffer + bytes_written);
-		}
-		else // 섹터 전체를 사용하지 못하고 일부만 쓸 수 있는 경우
-		{
-			/**
-			 * bounce 버퍼는 기존의 섹터 데이터를 백업해두기 위한 버퍼
-			 */
-			if (bounce == NULL)
-			{
-				bounce = malloc(DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* 현재 쓰려는 범위 앞뒤에 데이터가 있는 경우
-			   먼저 섹터를 읽어야 한다. 그렇지 않으면 0으로 채워진
-			   섹터에서 시작한다. */
-			if (sector_ofs > 0 || chunk_size < sector_left)
-				/* 기존 섹터 데이터를 bounce 버퍼에 저장 */
-				disk_read(filesys_disk, sector_idx, bounce);
-			else
-				memset(bounce, 0, DISK_SECTOR_SIZE);
-			memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size); // 덮어쓰려는 부분만 바꾸기
-			disk_write(filesys_disk, sector_idx, bounce);					 // 다시 전체 섹터를 디스크에 쓰기
-		}
+		/* 버퍼 캐시에 기록한다. 섹터 일부만 쓰는 경우의
+		 * read-modify-write는 캐시 안에서 처리된다. */
+		prepare_write(sector_idx);
+		data_write_at(inode, sector_idx, buffer + bytes_written, chunk_size, sector_ofs);
 
 		/* 진행. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free(bounce);
-	inode_flush(inode);
 
 	return bytes_written;
 }
 
+/* map_load()된 INODE의 클러스터가 디스크에서 몇 개의 연속 구간으로 나뉘어 있는지 센다. */
+static size_t
+count_fragments(struct inode *inode)
+{
+	size_t cnt = map_count(inode);
+	size_t fragments = cnt > 0 ? 1 : 0;
+
+	for (size_t i = 1; i < cnt; i++)
+		if (map_get(inode, i) != map_get(inode, i - 1) + 1)
+			fragments++;
+	return fragments;
+}
+
+/* INODE의 클러스터를 하나의 연속 구간으로 옮긴다.
+ * 옮기기 전과 후의 조각 수를 *BEFORE와 *AFTER에 저장한다.
+ * 연속된 빈 구간이 없거나 메모리가 모자라면 옮기지 않고 false를 반환한다.
+ * rwlock을 배타로 잡으므로 읽는 쪽은 옮기기 전이나 후의 상태만 보며,
+ * 새 구간의 할당과 inode 교체만 한 트랜잭션으로 커밋된다. 데이터 복사본은 디렉터리라도
+ * 로그를 거치지 않는 보통 데이터로 쓰고 커밋 전에 제자리에 기록되므로(ordered)
+ * 로그 크기는 파일 크기와 상관없다. 옛 체인은 교체가 끝난 뒤 따로 해제한다. */
+bool inode_defrag(struct inode *inode, size_t *before, size_t *after)
+{
+	cluster_t old_start = 0, old_block = 0;
+	bool success = false;
+
+	/* 옮길 클러스터 수는 rwlock을 잡은 뒤에야 알 수 있으므로 예약은 그때 늘린다. */
+	if (!journal_begin(0))
+		return false;
+	rw_write_acquire(&inode->rwlock);
+	*before = *after = 0;
+	if (is_inline(&inode->data) || !map_load(inode))
+	{
+		success = is_inline(&inode->data);
+		goto done;
+	}
+
+	size_t cnt = map_count(inode);
+	*before = *after = count_fragments(inode);
+	if (*before <= 1)
+	{
+		success = true;
+		goto done;
+	}
+
+	/* 새 구간의 FAT 섹터(양 끝이 걸칠 수 있다)와 inode 섹터 몫. 로그에 담기지 않으면 옮기지 않는다. */
+	if (!journal_extend(cnt / (DISK_SECTOR_SIZE / sizeof(cluster_t)) + 3))
+		goto done;
+
+	/* 예약 창은 다른 파일 몫이 아니므로 먼저 돌려주고 연속 구간을 찾는다. */
+	fat_unreserve(&inode->resv);
+	uint8_t *buffer = malloc(DISK_SECTOR_SIZE);
+	if (buffer == NULL)
+		goto done;
+	cluster_t start = fat_allocate_contiguous(cnt, fat_hint(inode->key.sector));
+	if (start == 0)
+	{
+		free(buffer);
+		goto done;
+	}
+
+	/* 데이터를 새 구간으로 복사한다. 아직 기록된 적 없는 클러스터는 표시만 옮긴다. */
+	for (size_t i = 0; i < cnt; i++)
+	{
+		cluster_t from = map_get(inode, i);
+		if (fat_is_unwritten(from))
+		{
+			fat_set_unwritten(start + i, true);
+			continue;
+		}
+		for (unsigned s = 0; s < fat_sectors_per_cluster(); s++)
+		{
+			buffer_cache_read(cluster_to_sector(from) + s, buffer);
+			buffer_cache_write(cluster_to_sector(start + i) + s, buffer);
+		}
+	}
+	free(buffer);
+
+	/* inode가 새 체인을 가리키게 한다. 옛 체인과 간접 익스텐트 블록은 트랜잭션을 마친 뒤 해제한다. */
+	old_start = inode->data.start;
+	inode->data.start = start;
+	if (use_extents())
+	{
+		old_block = inode->data.extent_block;
+		inode->data.extent_block = 0;
+		inode->data.extent_cnt = 1;
+		inode->data.extents[0] = (struct inode_extent){start, cnt};
+		extent_clear(inode);
+	}
+	else
+		cluster_index_clear(inode);
+	set_dirty(inode);
+	*after = 1;
+	success = true;
+
+done:
+	rw_write_release(&inode->rwlock);
+	journal_end();
+
+	release_chain(old_start);
+	release_chain(old_block);
+	return success;
+}
+
 /* INODE에 대한 쓰기를 금지한다.
    각 inode 오픈마다 한 번만 호출될 수 있다. */
 void inode_deny_write(struct inode *inode)
 {
+	rw_write_acquire(&inode->rwlock);
 	inode->deny_write_cnt++;
 	ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+	rw_write_release(&inode->rwlock);
 }
 
 /* INODE에 대한 쓰기를 다시 허용한다.
@@ -425,9 +1304,11 @@ void inode_deny_write(struct inode *inode)
  * 반드시 한 번 이 함수를 호출해야 한다. */
 void inode_allow_write(struct inode *inode)
 {
+	rw_write_acquire(&inode->rwlock);
 	ASSERT(inode->deny_write_cnt > 0);
 	ASSERT(inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rw_write_release(&inode->rwlock);
 }
 
 /* INODE 데이터의 길이(바이트)를 반환한다. */
@@ -436,9 +1317,39 @@ off_t inode_length(const struct inode *inode)
 	return inode->data.length;
 }
 
+/* INODE의 메타데이터를 버퍼 캐시의 inode 섹터에 기록한다. */
 void inode_flush(struct inode *inode)
 {
-	disk_write(filesys_disk, inode->sector, &inode->data);
+	inode->dirty = false;
+	buffer_cache_write_meta(inode->key.sector, &inode->data);
+}
+
+/* 열린 inode 중 메타데이터가 바뀐 것을 모두 버퍼 캐시에 기록한다.
+ * filesys_sync()와 플러시 스레드가 호출한다.
+ * 쓰는 중인 inode의 반쯤 고쳐진 data를 기록하지 않도록 각 inode의 rwlock을 공유로 잡는다. */
+void inode_flush_all(void)
+{
+	struct hash_iterator i;
+
+	lock_acquire(&open_inodes_lock);
+	hash_first(&i, &open_inodes);
+	while (hash_next(&i))
+	{
+		struct inode *inode = hash_entry(hash_cur(&i), struct inode, key.elem);
+		if (inode->dirty)
+		{
+			rw_read_acquire(&inode->rwlock);
+			inode_flush(inode);
+			rw_read_release(&inode->rwlock);
+		}
+	}
+	lock_release(&open_inodes_lock);
+}
+
+/* INODE의 메타데이터가 아직 버퍼 캐시에 기록되지 않았으면 true. */
+bool inode_is_dirty(const struct inode *inode)
+{
+	return inode->dirty;
 }
 
 bool is_dir(struct inode *inode)
@@ -446,9 +1357,43 @@ bool is_dir(struct inode *inode)
 	return inode->data.isdir;
 }
 
+/* 디렉터리 INODE가 해시 색인 형식이면 true. */
+bool inode_is_indexed(const struct inode *inode)
+{
+	return (inode->data.flags & INODE_INDEXED) != 0;
+}
+
+/* 디렉터리 INODE를 해시 색인 형식으로 표시한다. */
+void inode_set_indexed(struct inode *inode)
+{
+	rw_write_acquire(&inode->rwlock);
+	inode->data.flags |= INODE_INDEXED;
+	set_dirty(inode);
+	rw_write_release(&inode->rwlock);
+}
+
+/* 디렉터리 INODE의 이름 공간 락을 잡는다.
+ * 조회와 나열은 WRITE = false로 공유하고, 엔트리 추가/삭제는 배타로 잡는다. */
+void inode_dir_acquire(struct inode *inode, bool write)
+{
+	if (write)
+		rw_write_acquire(&inode->dir_lock);
+	else
+		rw_read_acquire(&inode->dir_lock);
+}
+
+/* inode_dir_acquire()로 잡은 락을 놓는다. */
+void inode_dir_release(struct inode *inode, bool write)
+{
+	if (write)
+		rw_write_release(&inode->dir_lock);
+	else
+		rw_read_release(&inode->dir_lock);
+}
+
 disk_sector_t get_dir_sector(struct dir *dir)
 {
-	return dir->inode->sector;
+	return dir->inode->key.sector;
 }
 
 bool is_good_inode(struct inode *inode)
@@ -468,7 +1413,7 @@ bool is_same_dir(struct dir *dir1, struct dir *dir2)
 
 disk_sector_t get_inode_sector(struct inode *inode)
 {
-	return inode->sector;
+	return inode->key.sector;
 }
 
 bool is_dir_removed(struct dir *dir)
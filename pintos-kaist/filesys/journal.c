@@ -0,0 +1,437 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* 메타데이터 선기록(write-ahead) 로그.
+ *
+ * 포맷 시 부트 섹터 뒤에 JOURNAL_SECTORS개 섹터를 예약한다.
+ * 첫 섹터는 헤더이고, 나머지는 로그 블록(메타데이터 섹터 사본)이다.
+ *
+ * 메타데이터(FAT 섹터, inode 섹터, 디렉터리 블록, 익스텐트 블록)는 버퍼 캐시에서
+ * 곧바로 제자리에 쓰이지 않는다. 교체되는 dirty 메타데이터는 로그 블록으로 가고,
+ * 동기화 시점에 남은 dirty 메타데이터까지 로그에 쓴 뒤 헤더 한 섹터를 기록하는 것으로
+ * 트랜잭션을 커밋한다. 그 다음에야 제자리에 기록(checkpoint)하고 헤더를 비운다.
+ * 일반 파일 데이터는 커밋 전에 먼저 제자리에 기록한다(ordered 모드).
+ *
+ * 마운트 시 커밋된 헤더가 남아 있으면 로그 블록을 제자리에 다시 써서(replay)
+ * 마지막으로 커밋된 상태를 복원한다. 헤더의 체크섬이 로그 블록과 맞지 않으면
+ * 커밋 도중 멈춘 것이므로 버린다.
+ *
+ * 한 트랜잭션이 로그보다 커지지 않도록 연산은 journal_begin()에서 자기가 새로 더럽힐 수 있는
+ * 메타데이터 섹터 수의 상한(credit)을 예약한다. 메타데이터 섹터가 트랜잭션 안에서 처음
+ * dirty가 될 때마다 journal_charge()가 예약에서 한 블록씩 쓰고, 연산이 끝나면 남은 예약을
+ * 돌려준다. 로그에 기록되는 서로 다른 섹터 수는 이렇게 쓴 블록 수를 넘지 않으므로
+ * 교체(steal) 때도 로그 자리가 항상 있다. 예약할 자리가 없으면 커밋으로 로그를 비운 뒤 시작한다. */
+
+#define JOURNAL_MAGIC 0x4a524e4c /* "JRNL" */
+
+/* 로그 영역 첫 섹터에 기록되는 헤더. CNT가 0이면 로그가 비어 있다. */
+struct journal_header
+{
+	uint32_t magic;					 /* JOURNAL_MAGIC. */
+	uint32_t cnt;					 /* 커밋된 로그 블록 수. */
+	uint64_t checksum;				 /* 로그 블록 CNT개의 체크섬. */
+	disk_sector_t home[JOURNAL_MAX]; /* 로그 블록 i가 기록될 제자리 섹터. */
+};
+
+/* 로그 영역. sectors가 0이면 저널을 쓰지 않는다. */
+static disk_sector_t journal_start;
+static size_t journal_blocks;
+
+/* 현재 로그에 쓰인 블록과 각 블록 내용의 해시. buffer_cache_lock이 보호하며,
+ * 커밋하는 동안에는 커밋하는 스레드만 로그 블록을 늘린다. */
+static disk_sector_t log_home[JOURNAL_MAX];
+static uint64_t log_hash[JOURNAL_MAX];
+static size_t log_cnt;
+
+/* 연산과 커밋 사이의 장벽.
+ * journal_begin()과 journal_end() 사이의 연산이 모두 끝나야 커밋을 시작하고,
+ * 커밋하는 동안에는 새 연산이 시작되지 않는다. */
+static struct lock barrier_lock;
+static struct condition barrier_cond;
+static int active_ops;
+static bool committing;
+
+/* 실행 중인 트랜잭션의 로그 사용량. barrier_lock이 보호한다.
+ * tx_used는 이번 트랜잭션에서 쓴 블록 수, tx_reserved는 진행 중인 연산이 예약해 두고
+ * 아직 쓰지 않은 블록 수이며, 둘의 합은 journal_blocks를 넘지 않는다. */
+static size_t tx_used;
+static size_t tx_reserved;
+
+/* 이번 트랜잭션에서 이미 센 메타데이터 섹터. barrier_lock이 보호한다.
+ * inode나 FAT은 메모리에서 바뀔 때 세고 캐시에 기록될 때 다시 부르므로, 섹터마다 한 번만 센다. */
+static disk_sector_t tx_charged[JOURNAL_MAX];
+static size_t tx_charged_cnt;
+
+/* -crash-on-sync: 테스트 프로그램이 시작된 뒤 처음으로 블록이 든 트랜잭션을 커밋하면
+ * checkpoint 없이 전원을 끈다. */
+bool journal_crash_on_sync;
+static bool crash_armed;
+
+static void set_region(disk_sector_t start, size_t sectors);
+static void write_header(uint32_t cnt, uint64_t checksum, const disk_sector_t *home);
+static uint64_t combine_hash(const uint64_t *hashes, size_t cnt);
+
+/* 저널 모듈을 초기화한다. 로그 영역은 journal_open()이 정할 때까지 없다. */
+void journal_init(void)
+{
+	lock_init(&barrier_lock);
+	cond_init(&barrier_cond);
+	active_ops = 0;
+	committing = false;
+	tx_used = tx_reserved = 0;
+	tx_charged_cnt = 0;
+	log_cnt = 0;
+	journal_blocks = 0;
+}
+
+/* START부터 SECTORS개 섹터를 로그 영역으로 쓴다.
+ * 커밋된 트랜잭션이 남아 있으면 제자리에 다시 기록한 뒤 로그를 비운다.
+ * 버퍼 캐시에 메타데이터가 올라오기 전에 호출해야 한다. */
+void journal_open(disk_sector_t start, size_t sectors)
+{
+	set_region(start, sectors);
+	if (journal_blocks == 0)
+		return;
+
+	static struct journal_header header;
+	static uint8_t block[DISK_SECTOR_SIZE];
+	disk_read(filesys_disk, journal_start, &header);
+	if (header.magic != JOURNAL_MAGIC || header.cnt == 0 || header.cnt > journal_blocks)
+		return;
+
+	for (size_t i = 0; i < header.cnt; i++)
+	{
+		disk_read(filesys_disk, journal_start + 1 + i, block);
+		log_hash[i] = hash_bytes(block, DISK_SECTOR_SIZE);
+	}
+	if (combine_hash(log_hash, header.cnt) == header.checksum)
+	{
+		for (size_t i = 0; i < header.cnt; i++)
+			if (header.home[i] != JOURNAL_DEAD)
+			{
+				disk_read(filesys_disk, journal_start + 1 + i, block);
+				disk_write(filesys_disk, header.home[i], block);
+			}
+		printf("journal: replayed %u sectors\n", (unsigned)header.cnt);
+	}
+	write_header(0, 0, NULL);
+}
+
+/* 포맷할 때 START부터 SECTORS개 섹터를 로그 영역으로 정하고 빈 헤더를 기록한다.
+ * 디스크에 남아 있던 예전 로그는 되살리지 않는다. */
+void journal_format(disk_sector_t start, size_t sectors)
+{
+	set_region(start, sectors);
+	if (journal_blocks > 0)
+		write_header(0, 0, NULL);
+}
+
+/* 로그 영역이 있는 디스크면 true. */
+bool journal_enabled(void)
+{
+	return journal_blocks > 0;
+}
+
+/* 메타데이터를 바꾸는 연산을 시작하고 로그 블록 CREDITS개를 예약한다.
+ * 가장 바깥 호출은 커밋 중이면 끝날 때까지, 예약할 자리가 없으면 다른 연산이 끝나거나
+ * 커밋으로 로그가 빌 때까지 기다린다. CREDITS가 로그 전체보다 크면 false를 반환한다.
+ * 중첩 호출은 바깥 연산의 남은 예약을 쓰고, 모자란 만큼은 journal_extend()처럼 더 받는다.
+ * 더 받을 수 없으면 false를 반환한다. false를 받았다면 journal_end()를 부르지 않는다.
+ * 파일 시스템 락을 잡기 전에 불러야 커밋과 교착하지 않는다. */
+bool journal_begin(size_t credits)
+{
+	struct thread *t = thread_current();
+
+	if (t->journal_depth > 0)
+	{
+		if (!journal_extend(credits))
+			return false;
+		t->journal_depth++;
+		return true;
+	}
+
+	if (!journal_enabled())
+	{
+		t->journal_depth = 1;
+		return true;
+	}
+	if (credits > journal_blocks)
+		return false;
+
+	lock_acquire(&barrier_lock);
+	for (;;)
+	{
+		if (committing)
+			cond_wait(&barrier_cond, &barrier_lock);
+		else if (tx_used + tx_reserved + credits <= journal_blocks)
+			break;
+		else if (tx_used + credits <= journal_blocks)
+		{
+			/* 다른 연산의 예약 때문에 모자라다. 그 연산이 끝나며 남은 예약을 돌려주기를 기다린다. */
+			cond_wait(&barrier_cond, &barrier_lock);
+		}
+		else
+		{
+			/* 이번 트랜잭션이 로그를 거의 다 썼다. 진행 중인 연산이 끝나는 대로 커밋해서 비운다. */
+			lock_release(&barrier_lock);
+			filesys_sync();
+			lock_acquire(&barrier_lock);
+		}
+	}
+	t->journal_depth = 1;
+	active_ops++;
+	tx_reserved += credits;
+	t->journal_credits = credits;
+	lock_release(&barrier_lock);
+	return true;
+}
+
+/* 현재 연산의 남은 예약이 CREDITS개보다 적으면 트랜잭션의 여유분에서 더 받는다.
+ * 연산 도중에는 커밋을 기다릴 수 없으므로 여유분이 모자라면 기다리지 않고 false를 반환한다.
+ * 호출자는 false를 받으면 메타데이터를 바꾸기 전에 연산을 실패시켜야 한다. */
+bool journal_extend(size_t credits)
+{
+	struct thread *t = thread_current();
+	bool success = true;
+
+	ASSERT(t->journal_depth > 0);
+	if (!journal_enabled() || t->journal_credits >= credits)
+		return true;
+
+	lock_acquire(&barrier_lock);
+	size_t more = credits - t->journal_credits;
+	if (tx_used + tx_reserved + more <= journal_blocks)
+	{
+		tx_reserved += more;
+		t->journal_credits += more;
+	}
+	else
+		success = false;
+	lock_release(&barrier_lock);
+	return success;
+}
+
+/* journal_begin()으로 시작한 연산을 끝낸다. 가장 바깥 호출이면 쓰지 않은 예약을 돌려준다. */
+void journal_end(void)
+{
+	struct thread *t = thread_current();
+	ASSERT(t->journal_depth > 0);
+	if (--t->journal_depth > 0 || !journal_enabled())
+		return;
+
+	/* 예약을 기다리는 연산과 커밋을 기다리는 스레드를 모두 깨운다. */
+	lock_acquire(&barrier_lock);
+	tx_reserved -= t->journal_credits;
+	t->journal_credits = 0;
+	active_ops--;
+	cond_broadcast(&barrier_cond, &barrier_lock);
+	lock_release(&barrier_lock);
+}
+
+/* 현재 스레드가 journal_begin()과 journal_end() 사이에 있으면 true.
+ * 연산 도중에는 커밋을 기다릴 수 없다. */
+bool journal_in_op(void)
+{
+	return thread_current()->journal_depth > 0;
+}
+
+/* 메타데이터 섹터 SECTOR가 dirty가 되었다. 이번 트랜잭션에서 처음이면 로그 블록 하나를 쓴다.
+ * 버퍼 캐시, FAT, inode가 각자의 락을 잡은 채 부른다.
+ * 연산 밖에서 부르는 경우(커밋 중의 기록, 닫을 때의 inode 기록)는 이미 어느 연산이
+ * 센 섹터를 다시 쓰는 것이라 사용량에만 더한다. */
+void journal_charge(disk_sector_t sector)
+{
+	struct thread *t = thread_current();
+
+	if (!journal_enabled())
+		return;
+
+	lock_acquire(&barrier_lock);
+	for (size_t i = 0; i < tx_charged_cnt; i++)
+		if (tx_charged[i] == sector)
+		{
+			lock_release(&barrier_lock);
+			return;
+		}
+	if (tx_charged_cnt < JOURNAL_MAX)
+		tx_charged[tx_charged_cnt++] = sector;
+	tx_used++;
+	if (t->journal_depth > 0)
+	{
+		if (t->journal_credits > 0)
+		{
+			t->journal_credits--;
+			tx_reserved--;
+		}
+		else if (tx_used + tx_reserved > journal_blocks)
+			PANIC("journal: operation dirtied more metadata than it reserved");
+	}
+	lock_release(&barrier_lock);
+}
+
+/* 진행 중인 연산이 모두 끝나기를 기다리고 새 연산을 막는다.
+ * 이후 메모리의 메타데이터를 캐시로 모아 커밋하면 연산 단위로 원자적이다. */
+void journal_quiesce(void)
+{
+	int own = thread_current()->journal_depth > 0 ? 1 : 0;
+
+	lock_acquire(&barrier_lock);
+	while (committing)
+		cond_wait(&barrier_cond, &barrier_lock);
+	committing = true;
+	while (active_ops > own)
+		cond_wait(&barrier_cond, &barrier_lock);
+	lock_release(&barrier_lock);
+}
+
+/* journal_quiesce()로 막은 연산을 다시 허용한다. */
+void journal_resume(void)
+{
+	lock_acquire(&barrier_lock);
+	committing = false;
+	cond_broadcast(&barrier_cond, &barrier_lock);
+	lock_release(&barrier_lock);
+}
+
+/* 로그 블록 중 SECTOR의 최신 사본이 있는 것의 번호. 없으면 -1. */
+static int
+find_slot(disk_sector_t sector)
+{
+	for (size_t i = 0; i < log_cnt; i++)
+		if (log_home[i] == sector)
+			return i;
+	return -1;
+}
+
+/* SECTOR를 디스크에서 읽을 때 실제로 읽어야 할 섹터.
+ * 아직 제자리에 기록되지 않은 메타데이터라면 로그 블록을 가리킨다. */
+disk_sector_t journal_locate(disk_sector_t sector)
+{
+	int slot = find_slot(sector);
+	return slot < 0 ? sector : journal_start + 1 + slot;
+}
+
+/* 메타데이터 섹터 SECTOR의 내용 DATA를 담을 로그 블록을 정하고 그 섹터 번호를 반환한다.
+ * 이미 로그에 있는 섹터면 같은 블록을 쓴다. 기록은 호출자가 DATA를 바꾸지 않은 채로 한다.
+ * 연산들의 예약이 로그 크기 안에 있으므로 새 블록은 항상 남아 있다. */
+disk_sector_t journal_log(disk_sector_t sector, const void *data)
+{
+	int slot = find_slot(sector);
+	if (slot < 0)
+	{
+		ASSERT(log_cnt < journal_blocks);
+		slot = log_cnt++;
+		log_home[slot] = sector;
+	}
+	log_hash[slot] = hash_bytes(data, DISK_SECTOR_SIZE);
+	return journal_start + 1 + slot;
+}
+
+/* SECTOR가 메타데이터가 아닌 데이터로 다시 쓰였다.
+ * 옛 메타데이터 사본이 replay나 checkpoint 때 새 데이터를 덮지 않도록 버린다. */
+void journal_forget(disk_sector_t sector)
+{
+	int slot = find_slot(sector);
+	if (slot >= 0)
+		log_home[slot] = JOURNAL_DEAD;
+}
+
+/* 로그에 쓰인 블록 수. */
+size_t journal_slot_count(void)
+{
+	return log_cnt;
+}
+
+/* 로그 블록 SLOT의 제자리 섹터. 버려진 블록이면 JOURNAL_DEAD. */
+disk_sector_t journal_slot_home(size_t slot)
+{
+	ASSERT(slot < log_cnt);
+	return log_home[slot];
+}
+
+/* 로그 블록 SLOT이 있는 디스크 섹터. */
+disk_sector_t journal_slot_sector(size_t slot)
+{
+	ASSERT(slot < log_cnt);
+	return journal_start + 1 + slot;
+}
+
+/* 지금까지 로그에 쓴 블록을 하나의 트랜잭션으로 커밋한다.
+ * 헤더 한 섹터의 기록이 커밋 지점이다. 로그 블록의 기록이 모두 끝난 뒤에 부른다. */
+void journal_commit(void)
+{
+	if (log_cnt > 0)
+	{
+		write_header(log_cnt, combine_hash(log_hash, log_cnt), log_home);
+		if (crash_armed)
+			power_off_unclean();
+	}
+}
+
+/* journal_crash_on_sync가 켜져 있으면 이후 처음으로 블록이 든 트랜잭션을 커밋한 직후에
+ * 전원을 끄도록 한다. 커밋됐지만 제자리에 기록되지 않은 트랜잭션을 남겨 다음 마운트의
+ * replay를 시험한다. 테스트를 실행하기 직전에 커널이 부른다. */
+void journal_arm_crash(void)
+{
+	if (journal_crash_on_sync)
+		crash_armed = true;
+}
+
+/* checkpoint가 끝난 뒤 빈 헤더를 기록해 로그를 버린다. */
+void journal_clear(void)
+{
+	if (log_cnt > 0)
+		write_header(0, 0, NULL);
+}
+
+/* journal_clear() 뒤에 로그 목록을 비우고 새 트랜잭션을 시작한다. */
+void journal_reset(void)
+{
+	log_cnt = 0;
+
+	lock_acquire(&barrier_lock);
+	tx_used = 0;
+	tx_charged_cnt = 0;
+	lock_release(&barrier_lock);
+}
+
+/* 로그 영역을 START부터 SECTORS개 섹터로 정하고 로그를 비운다. */
+static void
+set_region(disk_sector_t start, size_t sectors)
+{
+	log_cnt = 0;
+	journal_start = start;
+	journal_blocks = sectors > 1 ? sectors - 1 : 0;
+	if (journal_blocks > JOURNAL_MAX)
+		journal_blocks = JOURNAL_MAX;
+}
+
+/* 헤더 섹터를 기록한다. */
+static void
+write_header(uint32_t cnt, uint64_t checksum, const disk_sector_t *home)
+{
+	static struct journal_header header;
+
+	ASSERT(sizeof header == DISK_SECTOR_SIZE);
+	memset(&header, 0, sizeof header);
+	header.magic = JOURNAL_MAGIC;
+	header.cnt = cnt;
+	header.checksum = checksum;
+	if (cnt > 0)
+		memcpy(header.home, home, cnt * sizeof *home);
+	disk_write(filesys_disk, journal_start, &header);
+}
+
+/* 로그 블록 해시 CNT개를 하나의 체크섬으로 합친다. */
+static uint64_t
+combine_hash(const uint64_t *hashes, size_t cnt)
+{
+	return hash_bytes(hashes, cnt * sizeof *hashes);
+}
@@ -1,9 +1,21 @@
 /* page_cache.c: 페이지 캐시(버퍼 캐시) 구현 파일. */
 
 #include "vm/vm.h"
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "filesys/page_cache.h"
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
+static void buffer_cache_prefetch (disk_sector_t sector, size_t cnt);
+static void buffer_cache_write_sector (disk_sector_t sector, const void *buffer,
+		off_t size, off_t ofs, bool meta);
+static void buffer_cache_commit (void);
 
 /* 이 구조체는 수정하지 마십시오 */
 static const struct page_operations page_cache_op = {
@@ -13,38 +25,709 @@ static const struct page_operations page_cache_op = {
 	.type = VM_PAGE_CACHE,
 };
 
-tid_t page_cache_workerd;
+tid_t page_cache_workerd = TID_ERROR;
+
+/* 워커 데몬이 처리할 read-ahead 요청 큐 (원형 버퍼). */
+#define READAHEAD_QUEUE_SIZE 64
+static disk_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head;	 /* 다음에 꺼낼 요청의 위치. */
+static size_t readahead_cnt;	 /* 큐에 쌓인 요청 수. */
+static struct lock readahead_lock;
+static struct condition readahead_cond; /* 요청이 들어오면 signal. */
 
 /* 파일 vm을 위한 초기화 함수 */
 void
 pagecache_init (void) {
-	/* TODO: page_cache_kworkerd를 사용하여 페이지 캐시용 워커 데몬을 생성하세요 */
+	page_cache_workerd = thread_create ("pc_kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
 }
 
-/* 페이지 캐시를 초기화한다 */
+/* 페이지 캐시를 초기화한다.
+ * 파일 시스템은 섹터 단위 버퍼 캐시(아래)를 쓰고 read-ahead도 buffer_cache_readahead()가
+ * 맡으므로 VM_PAGE_CACHE 페이지는 만들지 않는다. 잘못 불리면 실패를 반환한다. */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED, void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return false;
 }
 
-/* Swap in 메커니즘을 활용하여 readhead(선행 읽기)를 구현하세요 */
+/* VM_PAGE_CACHE 페이지의 swap in. 선행 읽기는 buffer_cache_readahead()가 하므로 쓰지 않는다. */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page UNUSED, void *kva UNUSED) {
+	return false;
 }
 
-/* Swap out 메커니즘을 활용하여 writeback(쓰기 반영)을 구현하세요 */
+/* VM_PAGE_CACHE 페이지의 swap out. 쓰기 반영은 버퍼 캐시가 하므로 쓰지 않는다. */
 static bool
-page_cache_writeback (struct page *page) {
+page_cache_writeback (struct page *page UNUSED) {
+	return false;
 }
 
 /* page_cache를 파괴합니다. */
 static void
-page_cache_destroy (struct page *page) {
+page_cache_destroy (struct page *page UNUSED) {
+}
+
+/* page cache를 위한 worker 스레드.
+ * read-ahead 큐에서 섹터를 꺼내 버퍼 캐시로 미리 읽어 들인다.
+ * 큐 앞쪽의 요청이 연속된 섹터라면 최대 READAHEAD_SECTORS개를 묶어 한 번에 읽는다. */
+static void
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		lock_acquire (&readahead_lock);
+		while (readahead_cnt == 0)
+			cond_wait (&readahead_cond, &readahead_lock);
+		disk_sector_t sector = readahead_queue[readahead_head];
+		size_t cnt = 0;
+		do {
+			readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+			readahead_cnt--;
+			cnt++;
+		} while (readahead_cnt > 0 && cnt < READAHEAD_SECTORS
+				&& readahead_queue[readahead_head] == sector + cnt);
+		lock_release (&readahead_lock);
+
+		buffer_cache_prefetch (sector, cnt);
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/* 버퍼 캐시                                                                   */
+/*----------------------------------------------------------------------------*/
+
+/* 캐시 슬롯 하나. 파일 시스템 디스크의 섹터 하나를 담는다.
+ *
+ * buffer_cache_lock은 슬롯의 상태와 내용만 보호하며 디스크 I/O 동안에는 놓는다.
+ * I/O 중인 슬롯은 loading이나 writing으로 표시해 두고, 그 슬롯이 필요한 스레드는
+ * 캐시 전체가 아니라 그 슬롯의 io_done에서 기다린다. 한 섹터는 많아야 한 슬롯에만
+ * 있고, 한 슬롯에는 I/O가 하나만 걸리므로 같은 섹터에 대한 I/O가 겹치지 않는다. */
+struct buffer_cache_entry
+{
+	disk_sector_t sector;	  /* 캐시하고 있는 섹터 번호. */
+	bool valid;				  /* 슬롯이 사용 중이면 true. */
+	bool dirty;				  /* 디스크에 아직 반영되지 않았으면 true. */
+	bool accessed;			  /* clock 알고리즘의 참조 비트. */
+	bool meta;				  /* 메타데이터 섹터면 true. 저널을 거쳐 기록된다. */
+	bool loading;			  /* 디스크에서 읽어 오는 중. 내용을 읽거나 쓸 수 없다. */
+	bool writing;			  /* 디스크나 로그에 기록하는 중. 내용을 바꾸거나 교체할 수 없다. */
+	struct condition io_done; /* loading이나 writing이 끝나면 broadcast. */
+	uint8_t *data;			  /* DISK_SECTOR_SIZE 바이트 데이터. */
+};
+
+static struct buffer_cache_entry buffer_cache[BUFFER_CACHE_SIZE];
+static struct lock buffer_cache_lock; /* 슬롯 상태와 내용, 로그 목록을 보호하는 락. */
+static struct condition slot_cond;	  /* 교체할 수 있는 슬롯이 생기면 broadcast. */
+static size_t clock_hand;			  /* 다음 교체 후보 슬롯. */
+
+/* 커밋 중이면 true. 그동안 dirty 메타데이터는 교체하지 않는다(로그가 늘어나지 않도록). */
+static bool checkpointing;
+
+/* 로그 블록에서 읽고 있는 슬롯 수. 커밋은 이 값이 0이 된 뒤에야 로그 블록을 다시 쓰게 한다. */
+static size_t log_reads;
+static struct condition log_idle;
+
+/* flush와 커밋을 한 번에 하나씩 하게 하는 락. flush_buffer도 보호한다.
+ * buffer_cache_lock보다 먼저 잡는다. */
+static struct lock flush_lock;
+
+/* flush 시 dirty 섹터를 섹터 순서로 모아 기록하기 위한 버퍼. 캐시 전체를 담는다. */
+static uint8_t *flush_buffer;
+static struct buffer_cache_entry *flush_slots[BUFFER_CACHE_SIZE];
+static disk_sector_t flush_to[BUFFER_CACHE_SIZE];
+static struct disk_request flush_reqs[BUFFER_CACHE_SIZE];
+
+/* checkpoint할 로그 블록 번호와 제자리 섹터. 제자리 섹터 순서로 정렬한다. */
+static size_t ckpt_slot[JOURNAL_MAX];
+static disk_sector_t ckpt_home[JOURNAL_MAX];
+
+/* 교체할 때 함께 기록하는 dirty 슬롯 수의 상한. */
+#define EVICT_BATCH 4
+
+/* buffer_cache_read_multi()가 슬롯을 잡아 한 번에 읽는 섹터 수의 상한. */
+#define LOAD_RUN_MAX 16
+
+/* 버퍼 캐시를 초기화한다. 파일 시스템이 디스크에 접근하기 전에 호출해야 한다. */
+void
+buffer_cache_init (void) {
+	uint8_t *pages = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+			BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		buffer_cache[i].valid = false;
+		buffer_cache[i].dirty = false;
+		buffer_cache[i].accessed = false;
+		buffer_cache[i].meta = false;
+		buffer_cache[i].loading = false;
+		buffer_cache[i].writing = false;
+		cond_init (&buffer_cache[i].io_done);
+		buffer_cache[i].data = pages + i * DISK_SECTOR_SIZE;
+	}
+	lock_init (&buffer_cache_lock);
+	cond_init (&slot_cond);
+	clock_hand = 0;
+	checkpointing = false;
+	log_reads = 0;
+	cond_init (&log_idle);
+	lock_init (&flush_lock);
+	flush_buffer = palloc_get_multiple (PAL_ASSERT,
+			BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+
+	lock_init (&readahead_lock);
+	cond_init (&readahead_cond);
+	readahead_head = readahead_cnt = 0;
+}
+
+/* 슬롯 E의 I/O가 끝났다. E와 교체할 슬롯을 기다리는 스레드들을 깨운다. */
+static void
+buffer_cache_io_done (struct buffer_cache_entry *e) {
+	ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+	e->loading = false;
+	e->writing = false;
+	cond_broadcast (&e->io_done, &buffer_cache_lock);
+	cond_broadcast (&slot_cond, &buffer_cache_lock);
+}
+
+/* dirty인 슬롯 SLOTS[0..N)을 디스크에 기록한다. REQS는 요청 N개를 담을 공간이다.
+ * 요청을 모두 디스크 큐에 넣은 뒤 한꺼번에 기다리므로 디스패처가 순서를 정하고 이어지는 요청을 묶는다. 기록하는 동안 buffer_cache_lock을 놓는다.
+ * 저널을 쓰는 디스크의 메타데이터는 제자리 대신 로그에 기록(steal)한다.
+ * 교체는 연산 도중에도 일어나므로 여기서 커밋하지 않는다. 로그 자리는 연산들의
+ * 예약(journal_begin())이 보장한다. */
+static void
+buffer_cache_write_slots (struct buffer_cache_entry **slots, size_t n,
+		struct disk_request *reqs) {
+	ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+	bool journaled = journal_enabled ();
+	disk_sector_t to[BUFFER_CACHE_SIZE];
+
+	ASSERT (n <= BUFFER_CACHE_SIZE);
+	for (size_t k = 0; k < n; k++) {
+		struct buffer_cache_entry *e = slots[k];
+		ASSERT (e->valid && e->dirty && !e->loading && !e->writing);
+		to[k] = e->meta && journaled ? journal_log (e->sector, e->data) : e->sector;
+		e->dirty = false;
+		e->writing = true;
+	}
+
+	lock_release (&buffer_cache_lock);
+	for (size_t k = 0; k < n; k++)
+		disk_submit (&reqs[k], filesys_disk, to[k], 1, slots[k]->data, true);
+	for (size_t k = 0; k < n; k++)
+		disk_wait (&reqs[k]);
+	lock_acquire (&buffer_cache_lock);
+
+	for (size_t k = 0; k < n; k++)
+		buffer_cache_io_done (slots[k]);
+}
+
+/* 슬롯 E를 지금 교체할 수 있으면 true. */
+static bool
+buffer_cache_evictable (const struct buffer_cache_entry *e) {
+	return !e->loading && !e->writing
+		&& !(checkpointing && journal_enabled () && e->dirty && e->meta);
+}
+
+/* 교체하려는 dirty 슬롯 VICTIM을 기록한다. clock이 곧 만날 슬롯 중 최근에 쓰이지 않은
+ * dirty 슬롯도 EVICT_BATCH개까지 함께 기록해 디스크 큐에 요청이 여럿 쌓이게 한다. */
+static void
+buffer_cache_evict_dirty (struct buffer_cache_entry *victim) {
+	struct buffer_cache_entry *slots[EVICT_BATCH];
+	struct disk_request reqs[EVICT_BATCH];
+	size_t n = 0;
+
+	slots[n++] = victim;
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE && n < EVICT_BATCH; i++) {
+		struct buffer_cache_entry *e = &buffer_cache[(clock_hand + i) % BUFFER_CACHE_SIZE];
+		if (e != victim && e->valid && e->dirty && !e->accessed && buffer_cache_evictable (e))
+			slots[n++] = e;
+	}
+	buffer_cache_write_slots (slots, n, reqs);
+}
+
+/* 기록 중인 슬롯이 모두 끝나기를 기다린다. */
+static void
+buffer_cache_wait_writes (void) {
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++)
+		while (buffer_cache[i].writing)
+			cond_wait (&buffer_cache[i].io_done, &buffer_cache_lock);
+}
+
+/* SECTOR를 담고 있는 슬롯을 찾는다. 없으면 NULL. */
+static struct buffer_cache_entry *
+buffer_cache_lookup (disk_sector_t sector) {
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++)
+		if (buffer_cache[i].valid && buffer_cache[i].sector == sector)
+			return &buffer_cache[i];
+	return NULL;
+}
+
+/* clock 알고리즘으로 비울 슬롯을 골라 반환한다. I/O 중인 슬롯과, 커밋 중에는
+ * dirty 메타데이터 슬롯을 건너뛴다. 고를 슬롯이 없으면 WAIT가 true일 때는
+ * 슬롯이 풀리기를 기다리고, false일 때는 NULL을 반환한다. */
+static struct buffer_cache_entry *
+buffer_cache_select_victim (bool wait) {
+	for (;;) {
+		for (size_t n = 0; n < 2 * BUFFER_CACHE_SIZE; n++) {
+			struct buffer_cache_entry *e = &buffer_cache[clock_hand];
+			clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+			if (!e->valid)
+				return e;
+			if (!buffer_cache_evictable (e))
+				continue;
+			if (e->accessed)
+				e->accessed = false;
+			else
+				return e;
+		}
+		if (!wait)
+			return NULL;
+		cond_wait (&slot_cond, &buffer_cache_lock);
+	}
+}
+
+/* SECTOR를 담을 슬롯을 골라 loading 상태로 잡아 반환한다. 캐시에 SECTOR가 없을 때 부른다.
+ * 고른 슬롯이 dirty라면 기록하느라 락을 놓게 되므로, 기록만 하고 NULL을 반환해
+ * 호출자가 캐시를 다시 확인하게 한다. WAIT의 뜻은 buffer_cache_select_victim()과 같다. */
+static struct buffer_cache_entry *
+buffer_cache_claim (disk_sector_t sector, bool wait) {
+	struct buffer_cache_entry *e = buffer_cache_select_victim (wait);
+	if (e == NULL)
+		return NULL;
+	if (e->valid && e->dirty) {
+		buffer_cache_evict_dirty (e);
+		return NULL;
+	}
+	e->sector = sector;
+	e->valid = true;
+	e->dirty = false;
+	e->meta = false;
+	e->accessed = true;
+	e->loading = true;
+	return e;
+}
+
+/* 잡아 둔 슬롯 E에 디스크의 내용을 읽어 들인다. 읽는 동안 buffer_cache_lock을 놓는다. */
+static void
+buffer_cache_load (struct buffer_cache_entry *e) {
+	ASSERT (e->loading);
+
+	disk_sector_t from = journal_locate (e->sector);
+	bool from_log = from != e->sector;
+	if (from_log)
+		log_reads++;
+
+	lock_release (&buffer_cache_lock);
+	disk_read (filesys_disk, from, e->data);
+	lock_acquire (&buffer_cache_lock);
+
+	if (from_log && --log_reads == 0)
+		cond_broadcast (&log_idle, &buffer_cache_lock);
+	buffer_cache_io_done (e);
+}
+
+/* SECTOR에 대한 슬롯을 반환한다. 캐시에 없으면 새 슬롯을 할당하며,
+ * LOAD가 true일 때만 디스크에서 내용을 읽어 온다.
+ * (섹터 전체를 덮어쓸 때는 읽을 필요가 없다.)
+ * 다른 스레드가 읽어 오는 중인 슬롯이면 끝날 때까지 기다린다. */
+static struct buffer_cache_entry *
+buffer_cache_get (disk_sector_t sector, bool load) {
+	ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+	for (;;) {
+		struct buffer_cache_entry *e = buffer_cache_lookup (sector);
+		if (e != NULL) {
+			if (e->loading) {
+				cond_wait (&e->io_done, &buffer_cache_lock);
+				continue;
+			}
+			e->accessed = true;
+			return e;
+		}
+
+		e = buffer_cache_claim (sector, true);
+		if (e == NULL)
+			continue;
+		if (load)
+			buffer_cache_load (e);
+		else
+			e->loading = false;
+		return e;
+	}
+}
+
+/* SECTOR의 OFS 위치부터 SIZE 바이트를 BUFFER로 읽는다. */
+void
+buffer_cache_read_at (disk_sector_t sector, void *buffer, off_t size, off_t ofs) {
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&buffer_cache_lock);
+	struct buffer_cache_entry *e = buffer_cache_get (sector, true);
+	memcpy (buffer, e->data + ofs, size);
+	lock_release (&buffer_cache_lock);
+}
+
+/* BUFFER의 SIZE 바이트를 SECTOR의 OFS 위치에 기록한다.
+ * 캐시에만 반영되며 디스크에는 교체되거나 flush될 때 기록된다. */
+void
+buffer_cache_write_at (disk_sector_t sector, const void *buffer, off_t size, off_t ofs) {
+	buffer_cache_write_sector (sector, buffer, size, ofs, false);
+}
+
+/* buffer_cache_write_at()과 같지만 SECTOR를 메타데이터로 표시한다.
+ * 메타데이터는 커밋된 트랜잭션을 통해서만 제자리에 기록된다. */
+void
+buffer_cache_write_meta_at (disk_sector_t sector, const void *buffer, off_t size, off_t ofs) {
+	buffer_cache_write_sector (sector, buffer, size, ofs, true);
 }
 
-/* page cache를 위한 worker 스레드 */
+/* buffer_cache_write_at()과 buffer_cache_write_meta_at()의 본체.
+ * 기록 중인 슬롯은 기록이 끝난 뒤에 바꾼다. */
 static void
-page_cache_kworkerd (void *aux) {
+buffer_cache_write_sector (disk_sector_t sector, const void *buffer,
+		off_t size, off_t ofs, bool meta) {
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&buffer_cache_lock);
+	bool whole = ofs == 0 && size == DISK_SECTOR_SIZE;
+	struct buffer_cache_entry *e;
+	for (;;) {
+		e = buffer_cache_get (sector, !whole);
+		if (!e->writing)
+			break;
+		cond_wait (&e->io_done, &buffer_cache_lock);
+	}
+	if (meta && !(e->dirty && e->meta))
+		journal_charge (sector);
+	memcpy (e->data + ofs, buffer, size);
+	e->dirty = true;
+	e->meta = meta;
+	if (!meta)
+		journal_forget (sector);
+	lock_release (&buffer_cache_lock);
+}
+
+/* SECTOR부터 CNT개의 연속된 섹터를 BUFFER로 읽는다.
+ * 캐시에 있는 섹터는 캐시에서 복사하고, 캐시에 없는 연속 구간은 슬롯을
+ * LOAD_RUN_MAX개까지 잡아 둔 뒤 disk_read_multi() 한 번으로 읽어 캐시에도 올린다. */
+void
+buffer_cache_read_multi (disk_sector_t sector, size_t cnt, void *buffer_) {
+	uint8_t *buffer = buffer_;
+	struct buffer_cache_entry *run[LOAD_RUN_MAX];
+
+	lock_acquire (&buffer_cache_lock);
+	for (size_t i = 0; i < cnt; ) {
+		if (buffer_cache_lookup (sector + i) != NULL
+				|| journal_locate (sector + i) != sector + i) {
+			struct buffer_cache_entry *e = buffer_cache_get (sector + i, true);
+			memcpy (buffer + i * DISK_SECTOR_SIZE, e->data, DISK_SECTOR_SIZE);
+			i++;
+			continue;
+		}
+
+		/* 이미 잡은 슬롯을 든 채로 다른 슬롯이 풀리기를 기다리면 교착할 수 있으므로
+		 * 첫 슬롯만 기다려서 잡는다. */
+		size_t n = 0;
+		while (i + n < cnt && n < LOAD_RUN_MAX
+				&& buffer_cache_lookup (sector + i + n) == NULL
+				&& journal_locate (sector + i + n) == sector + i + n) {
+			struct buffer_cache_entry *e = buffer_cache_claim (sector + i + n, n == 0);
+			if (e == NULL) {
+				if (n == 0)
+					continue;
+				break;
+			}
+			run[n++] = e;
+		}
+		if (n == 0)
+			continue;
+
+		lock_release (&buffer_cache_lock);
+		disk_read_multi (filesys_disk, sector + i, n, buffer + i * DISK_SECTOR_SIZE);
+		lock_acquire (&buffer_cache_lock);
+		for (size_t k = 0; k < n; k++) {
+			memcpy (run[k]->data, buffer + (i + k) * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
+			buffer_cache_io_done (run[k]);
+		}
+		i += n;
+	}
+	lock_release (&buffer_cache_lock);
+}
+
+/* SECTOR부터 CNT개의 섹터 중 캐시에 없는 것을 디스크에서 읽어 캐시에 올려 둔다.
+ * 기다리지 않고 잡을 수 있는 슬롯만 잡아 loading으로 표시한 뒤 락을 놓고 읽으므로,
+ * 그동안 다른 섹터를 쓰는 스레드는 막히지 않고 이 섹터를 읽으려는 스레드만 그 슬롯을 기다린다.
+ * 슬롯마다 요청을 넣으면 디스크 디스패처가 이어지는 요청을 한 명령으로 묶는다. */
+static void
+buffer_cache_prefetch (disk_sector_t sector, size_t cnt) {
+	struct buffer_cache_entry *run[READAHEAD_SECTORS];
+	struct disk_request reqs[READAHEAD_SECTORS];
+	size_t n = 0;
+
+	lock_acquire (&buffer_cache_lock);
+	for (size_t i = 0; i < cnt && n < READAHEAD_SECTORS; i++) {
+		if (buffer_cache_lookup (sector + i) != NULL
+				|| journal_locate (sector + i) != sector + i)
+			continue;
+		struct buffer_cache_entry *e = buffer_cache_claim (sector + i, false);
+		if (e == NULL)
+			break;
+		run[n++] = e;
+	}
+	lock_release (&buffer_cache_lock);
+
+	for (size_t k = 0; k < n; k++)
+		disk_submit (&reqs[k], filesys_disk, run[k]->sector, 1, run[k]->data, false);
+	for (size_t k = 0; k < n; k++)
+		disk_wait (&reqs[k]);
+
+	lock_acquire (&buffer_cache_lock);
+	for (size_t k = 0; k < n; k++)
+		buffer_cache_io_done (run[k]);
+	lock_release (&buffer_cache_lock);
+}
+
+/* SECTOR를 비동기로 미리 읽도록 워커 데몬에 요청한다.
+ * 워커가 없거나 큐가 가득 차 있으면 요청을 버린다. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	if (page_cache_workerd == TID_ERROR)
+		return;
+
+	lock_acquire (&readahead_lock);
+	if (readahead_cnt < READAHEAD_QUEUE_SIZE) {
+		size_t tail = (readahead_head + readahead_cnt) % READAHEAD_QUEUE_SIZE;
+		readahead_queue[tail] = sector;
+		readahead_cnt++;
+		cond_signal (&readahead_cond, &readahead_lock);
+	}
+	lock_release (&readahead_lock);
+}
+
+/* disk_read()와 같은 역할을 캐시를 통해 수행한다. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer) {
+	buffer_cache_read_at (sector, buffer, DISK_SECTOR_SIZE, 0);
+}
+
+/* disk_write()와 같은 역할을 캐시를 통해 수행한다. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer) {
+	buffer_cache_write_at (sector, buffer, DISK_SECTOR_SIZE, 0);
+}
+
+/* buffer_cache_write()의 메타데이터판. */
+void
+buffer_cache_write_meta (disk_sector_t sector, const void *buffer) {
+	buffer_cache_write_meta_at (sector, buffer, DISK_SECTOR_SIZE, 0);
+}
+
+/* flush_buffer의 섹터 K를 디스크 섹터 TO[K]에 기록한다(K < CNT). TO는 오름차순이다.
+ * TO가 이어지는 구간마다 요청 하나를 만들어 모두 디스크 큐에 넣은 뒤 한꺼번에 기다린다.
+ * buffer_cache_lock 없이 flush_lock을 잡고 부른다. */
+static void
+flush_runs (const disk_sector_t *to, size_t cnt) {
+	size_t reqs = 0;
+
+	ASSERT (lock_held_by_current_thread (&flush_lock));
+	for (size_t k = 0; k < cnt; ) {
+		size_t run = 1;
+		while (k + run < cnt && run < DISK_MULTI_MAX && to[k + run] == to[k] + run)
+			run++;
+		disk_submit (&flush_reqs[reqs++], filesys_disk, to[k], run,
+				flush_buffer + k * DISK_SECTOR_SIZE, true);
+		k += run;
+	}
+	for (size_t r = 0; r < reqs; r++)
+		disk_wait (&flush_reqs[r]);
+}
+
+/* 저널을 거치지 않는 dirty 슬롯을 섹터 순서대로 디스크에 기록한다.
+ * 모든 dirty 슬롯을 flush_buffer에 섹터 순서로 모으고, 섹터 번호가 이어지는 구간마다
+ * 요청 하나를 만들어 한꺼번에 디스크 큐에 넣은 뒤 모두 끝나기를 기다린다.
+ * 교체로 기록 중이던 슬롯도 끝나기를 기다린다. */
+static void
+buffer_cache_write_back (void) {
+	ASSERT (lock_held_by_current_thread (&flush_lock));
+	bool journaled = journal_enabled ();
+	size_t cnt = 0;
+
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct buffer_cache_entry *e = &buffer_cache[i];
+		if (!e->valid || !e->dirty || e->writing || (journaled && e->meta))
+			continue;
+		/* 섹터 순서로 삽입 정렬. */
+		size_t k = cnt++;
+		for (; k > 0 && flush_slots[k - 1]->sector > e->sector; k--)
+			flush_slots[k] = flush_slots[k - 1];
+		flush_slots[k] = e;
+	}
+
+	for (size_t k = 0; k < cnt; k++) {
+		struct buffer_cache_entry *e = flush_slots[k];
+		memcpy (flush_buffer + k * DISK_SECTOR_SIZE, e->data, DISK_SECTOR_SIZE);
+		flush_to[k] = e->sector;
+		e->dirty = false;
+		e->writing = true;
+	}
+
+	lock_release (&buffer_cache_lock);
+	flush_runs (flush_to, cnt);
+	lock_acquire (&buffer_cache_lock);
+
+	for (size_t k = 0; k < cnt; k++)
+		buffer_cache_io_done (flush_slots[k]);
+	buffer_cache_wait_writes ();
+}
+
+/* 커밋할 dirty 메타데이터 슬롯을 모두 로그에 기록한다.
+ * 새로 로그에 들어가는 섹터는 이어지는 로그 블록을 받으므로, 내용을 flush_buffer에
+ * 로그 블록 순서로 모아 이어지는 구간마다 한 번의 쓰기로 기록한다. */
+static void
+buffer_cache_stage_log (void) {
+	size_t cnt = 0;
+
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		struct buffer_cache_entry *e = &buffer_cache[i];
+		if (!e->valid || !e->dirty || !e->meta)
+			continue;
+		disk_sector_t to = journal_log (e->sector, e->data);
+		size_t k = cnt++;
+		for (; k > 0 && flush_to[k - 1] > to; k--) {
+			flush_to[k] = flush_to[k - 1];
+			flush_slots[k] = flush_slots[k - 1];
+		}
+		flush_to[k] = to;
+		flush_slots[k] = e;
+		e->dirty = false;
+		e->writing = true;
+	}
+	for (size_t k = 0; k < cnt; k++)
+		memcpy (flush_buffer + k * DISK_SECTOR_SIZE, flush_slots[k]->data, DISK_SECTOR_SIZE);
+
+	lock_release (&buffer_cache_lock);
+	flush_runs (flush_to, cnt);
+	lock_acquire (&buffer_cache_lock);
+
+	for (size_t k = 0; k < cnt; k++)
+		buffer_cache_io_done (flush_slots[k]);
+}
+
+/* 커밋된 로그 블록을 제자리에 기록한다(checkpoint). 제자리 섹터 순서로 정렬해
+ * BUFFER_CACHE_SIZE개씩 flush_buffer에 모은 뒤, 이어지는 섹터를 한 번의 쓰기로 기록한다.
+ * 커밋한 뒤 다시 바뀌지 않은 슬롯은 로그 블록과 내용이 같으므로 캐시에서 복사하고,
+ * 나머지는 로그 블록을 읽어 온다. */
+static void
+buffer_cache_checkpoint (void) {
+	size_t cnt = 0;
+
+	for (size_t slot = 0; slot < journal_slot_count (); slot++) {
+		disk_sector_t home = journal_slot_home (slot);
+		if (home == JOURNAL_DEAD)
+			continue;
+		size_t k = cnt++;
+		for (; k > 0 && ckpt_home[k - 1] > home; k--) {
+			ckpt_home[k] = ckpt_home[k - 1];
+			ckpt_slot[k] = ckpt_slot[k - 1];
+		}
+		ckpt_home[k] = home;
+		ckpt_slot[k] = slot;
+	}
+
+	for (size_t base = 0; base < cnt; base += BUFFER_CACHE_SIZE) {
+		size_t n = cnt - base < BUFFER_CACHE_SIZE ? cnt - base : BUFFER_CACHE_SIZE;
+		size_t reads = 0;
+
+		for (size_t k = 0; k < n; k++) {
+			struct buffer_cache_entry *e = buffer_cache_lookup (ckpt_home[base + k]);
+			uint8_t *to = flush_buffer + k * DISK_SECTOR_SIZE;
+			if (e != NULL && !e->loading && !e->dirty)
+				memcpy (to, e->data, DISK_SECTOR_SIZE);
+			else
+				disk_submit (&flush_reqs[reads++], filesys_disk,
+						journal_slot_sector (ckpt_slot[base + k]), 1, to, false);
+		}
+
+		lock_release (&buffer_cache_lock);
+		for (size_t r = 0; r < reads; r++)
+			disk_wait (&flush_reqs[r]);
+		flush_runs (ckpt_home + base, n);
+		lock_acquire (&buffer_cache_lock);
+	}
+}
+
+/* 캐시의 dirty 데이터를 먼저 기록하고(ordered), dirty 메타데이터를 모두 로그에 쓴 뒤
+ * 트랜잭션을 커밋한다. 이어서 로그의 모든 블록을 제자리에 기록하고 로그를 비운다.
+ * 디스크 I/O 동안에는 buffer_cache_lock을 놓으므로 다른 스레드는 캐시를 계속 쓸 수 있다.
+ * 그동안 다시 dirty가 된 메타데이터는 다음 트랜잭션에 속한다. */
+static void
+buffer_cache_commit (void) {
+	ASSERT (lock_held_by_current_thread (&flush_lock));
+	ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+	buffer_cache_write_back ();
+	if (!journal_enabled ())
+		return;
+
+	checkpointing = true;
+	buffer_cache_wait_writes ();
+	buffer_cache_stage_log ();
+
+	lock_release (&buffer_cache_lock);
+	journal_commit ();
+	lock_acquire (&buffer_cache_lock);
+
+	buffer_cache_checkpoint ();
+
+	lock_release (&buffer_cache_lock);
+	journal_clear ();
+	lock_acquire (&buffer_cache_lock);
+	journal_reset ();
+
+	/* 로그 블록을 읽는 중인 슬롯이 끝나야 다음 트랜잭션이 로그 블록을 덮어쓸 수 있다. */
+	while (log_reads > 0)
+		cond_wait (&log_idle, &buffer_cache_lock);
+
+	/* 커밋하는 동안 다시 dirty가 된 메타데이터는 새 트랜잭션의 로그 자리를 쓴다. */
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++)
+		if (buffer_cache[i].valid && buffer_cache[i].dirty && buffer_cache[i].meta)
+			journal_charge (buffer_cache[i].sector);
+
+	checkpointing = false;
+	cond_broadcast (&slot_cond, &buffer_cache_lock);
+}
+
+/* dirty인 모든 슬롯을 디스크에 반영한다.
+ * 저널을 쓰는 디스크에서는 메타데이터를 하나의 트랜잭션으로 커밋한다. */
+void
+buffer_cache_flush (void) {
+	lock_acquire (&flush_lock);
+	lock_acquire (&buffer_cache_lock);
+	buffer_cache_commit ();
+	lock_release (&buffer_cache_lock);
+	lock_release (&flush_lock);
+}
+
+/* 저널을 거치지 않는 dirty 슬롯만 디스크에 기록한다.
+ * 커밋되지 않은 메타데이터가 캐시나 로그에 남아 있지 않으면 true를 반환한다. */
+bool
+buffer_cache_flush_data (void) {
+	lock_acquire (&flush_lock);
+	lock_acquire (&buffer_cache_lock);
+	buffer_cache_write_back ();
+	bool clean = journal_slot_count () == 0;
+	for (size_t i = 0; i < BUFFER_CACHE_SIZE && clean; i++)
+		if (buffer_cache[i].valid && buffer_cache[i].dirty)
+			clean = false;
+	lock_release (&buffer_cache_lock);
+	lock_release (&flush_lock);
+	return clean;
+}
+
+/* 버퍼 캐시를 종료하며 남은 데이터를 디스크에 기록한다. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
 }
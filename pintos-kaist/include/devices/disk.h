@@ -2,7 +2,11 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "threads/synch.h"
 
 /* Size of a disk sector in bytes. */
 #define DISK_SECTOR_SIZE 512
@@ -15,6 +19,24 @@ typedef uint32_t disk_sector_t;
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Maximum number of sectors moved by one disk_*_multi() call. */
+#define DISK_MULTI_MAX 256
+
+/* Use bus-master DMA when available (kernel option -dma). */
+extern bool disk_use_dma;
+
+/* A read or write queued on a disk's channel.
+ * Filled in by disk_submit() and completed by the channel's dispatcher. */
+struct disk_request {
+	struct disk *disk;      /* Target disk. */
+	disk_sector_t sec_no;   /* First sector. */
+	size_t cnt;             /* Number of sectors (1 to DISK_MULTI_MAX). */
+	void *buffer;           /* cnt * DISK_SECTOR_SIZE bytes. */
+	bool write;             /* true: buffer -> disk, false: disk -> buffer. */
+	struct semaphore done;  /* Upped when the request completes. */
+	struct list_elem elem;  /* Element in the channel queue. */
+};
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,6 +44,11 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multi (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multi (struct disk *, disk_sector_t, size_t cnt, const void *);
+void disk_submit (struct disk_request *, struct disk *, disk_sector_t,
+		size_t cnt, void *buffer, bool write);
+void disk_wait (struct disk_request *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
@@ -12,8 +12,23 @@
  * retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* 엔트리 하나를 고치는 연산(dir_remove())이 예약하는 로그 블록 수.
+ * 섹터 경계에 걸친 엔트리 하나를 쓰는 inode_write_at()의 상한이다. */
+#define DIR_ENTRY_CREDITS 10
+
+/* 색인 버킷 한 번 나누기가 쓰는 로그 블록 수의 상한. 섹터 하나인 버킷 둘(7씩)과
+ * 표의 절반(1024바이트) 이하라 섹터 셋까지 걸치는 버킷 표 일부(13)를 inode_write_at()으로
+ * 쓰는 몫이다. */
+#define DIR_SPLIT_CREDITS 27
+
+/* dir_add()가 예약하는 로그 블록 수. 엔트리 하나와 색인 버킷 한 번 나누기를 담아,
+ * 첫 나누기는 트랜잭션 여유분과 상관없이 할 수 있다. 더 필요하면 그때 더 받는다. */
+#define DIR_ADD_CREDITS (DIR_ENTRY_CREDITS + DIR_SPLIT_CREDITS)
+
 struct inode;
 
+void dir_cache_init(void);
+
 /* Opening and closing directories. */
 bool dir_create(disk_sector_t sector, size_t entry_cnt);
 struct dir *dir_open(struct inode *);
@@ -24,9 +39,11 @@ struct inode *dir_get_inode(struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup(const struct dir *, const char *name, struct inode **);
-bool dir_add(struct dir *, const char *name, disk_sector_t);
+bool dir_add(struct dir *, const char *name, disk_sector_t, bool isdir);
 bool dir_remove(struct dir *, const char *name);
 bool dir_readdir(struct dir *, char name[NAME_MAX + 1]);
+struct dir_entry;
+size_t dir_read_entries(struct dir *, struct dir_entry *, size_t max);
 void dump_dir(struct dir *dir);
 
 /* 디렉터리 구조체. */
@@ -41,6 +58,7 @@ struct dir_entry
     disk_sector_t inode_sector; /* 헤더가 위치한 섹터 번호. */
     char name[NAME_MAX + 1];    /* 널 종료된 파일 이름. */
     bool in_use;                /* 사용 중인지 여부. */
+    bool isdir;                 /* 디렉터리를 가리키면 true. inode를 열지 않고 종류를 알 수 있다. */
 };
 
 #endif /* filesys/directory.h */
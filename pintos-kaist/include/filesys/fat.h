@@ -4,6 +4,7 @@
 #include "devices/disk.h"
 #include "filesys/file.h"
 #include <inttypes.h>
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -12,32 +13,74 @@ typedef uint32_t cluster_t; /* Index of a cluster within FAT. */
 
 #define FAT_MAGIC 0xEB3C9000 /* MAGIC string to identify FAT disk */
 #define EOChain 0x0FFFFFFF   /* End of cluster chain */
+#define FAT_UNWRITTEN 0x80000000 /* Entry flag: allocated but never written */
 
 /* Sectors of FAT information. */
-#define SECTORS_PER_CLUSTER 1 /* Number of sectors per cluster */
+#define SECTORS_PER_CLUSTER 1 /* Default number of sectors per cluster */
+#define MAX_SECTORS_PER_CLUSTER 64 /* Largest cluster size allowed at format */
 #define FAT_BOOT_SECTOR 0     /* FAT boot sector. */
 #define ROOT_DIR_CLUSTER 1    /* Cluster for the root directory */
 
+/* Features recorded in the boot sector at format time. */
+#define FAT_FEATURE_EXTENTS 0x1 /* Inodes map data with extent lists */
+
+/* Clusters set aside for one growing file so that concurrent
+ * appenders do not interleave their clusters on disk.
+ * Windows still count as free space and are given up when the
+ * disk would otherwise run out. */
+struct fat_reservation {
+    cluster_t start;       /* Next reserved cluster. */
+    size_t cnt;            /* Reserved clusters left, starting at start. */
+    struct list_elem elem; /* In the list of open windows while cnt > 0. */
+};
+
+/* Sectors per cluster used by the next format (kernel option -cs). */
+extern unsigned int fat_format_cluster_sectors;
+/* Features enabled by the next format (kernel option -extents). */
+extern unsigned int fat_format_features;
+/* Read the rest of the FAT in the background after mount (-fat-prefetch). */
+extern bool fat_prefetch;
+
 void fat_init(void);
 void fat_open(void);
 void fat_close(void);
 void fat_create(void);
-void fat_close(void);
+void fat_sync(void);
+bool fat_is_dirty(void);
+void fat_commit_frees(void);
+bool fat_has_pending_frees(void);
 
 cluster_t fat_create_chain(
     cluster_t clst /* Cluster # to stretch, 0: Create a new chain */
 );
+cluster_t fat_extend_chain(
+    cluster_t tail, /* Last cluster of the chain, 0: Create a new chain */
+    size_t cnt      /* Number of clusters to append */
+);
+cluster_t fat_extend_reserved(cluster_t tail, size_t cnt, cluster_t goal,
+                              struct fat_reservation *);
+void fat_unreserve(struct fat_reservation *);
 void fat_remove_chain(
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
 cluster_t fat_get(cluster_t clst);
 void fat_put(cluster_t clst, cluster_t val);
+bool fat_is_unwritten(cluster_t clst);
+void fat_set_unwritten(cluster_t clst, bool unwritten);
 disk_sector_t cluster_to_sector(cluster_t clst);
+unsigned int fat_sectors_per_cluster(void);
+bool fat_has_feature(unsigned int feature);
 cluster_t find_free_cluster(void);
+cluster_t fat_find_free_run(cluster_t from, size_t cnt, size_t *lenp);
+size_t fat_free_clusters(void);
 void create_root_dir_inode(void);
 bool fat_allocate(size_t cnt, disk_sector_t *sectorp);
+bool fat_allocate_near(size_t cnt, cluster_t goal, cluster_t *clusterp);
+cluster_t fat_hint(disk_sector_t sector);
+cluster_t fat_allocate_contiguous(size_t cnt, cluster_t goal);
 void fat_release(cluster_t clst);
+cluster_t fat_release_bounded(cluster_t clst, size_t sectors);
 cluster_t sector_to_cluster(disk_sector_t sector);
 
 #endif /* filesys/fat.h */
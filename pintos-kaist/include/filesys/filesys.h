@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 
+struct inode;
+
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
@@ -13,6 +15,8 @@ extern struct disk *filesys_disk;
 
 void filesys_init(bool format);
 void filesys_done(void);
+void filesys_sync(void);
+void filesys_fsync(struct inode *, bool data_only);
 bool filesys_create(const char *name, off_t initial_size);
 struct file *filesys_open(const char *name);
 bool filesys_remove(const char *name);
@@ -8,6 +8,14 @@
 
 struct bitmap;
 
+/* inode_create()가 한 트랜잭션에서 만들 수 있는 길이의 상한.
+ * 더 긴 파일은 만든 뒤 inode_grow()로 늘린다. */
+#define INODE_CREATE_MAX (16 * DISK_SECTOR_SIZE)
+
+/* 길이가 INODE_CREATE_MAX 이하인 inode_create()가 예약하는 로그 블록 수:
+ * 클러스터마다 FAT 섹터 하나, 그리고 inode 섹터와 간접 익스텐트 블록 몫. */
+#define INODE_CREATE_CREDITS (INODE_CREATE_MAX / DISK_SECTOR_SIZE + 4)
+
 void inode_init(void);
 bool inode_create(disk_sector_t, off_t, bool);
 struct inode *inode_open(disk_sector_t);
@@ -17,11 +25,22 @@ void inode_close(struct inode *);
 void inode_remove(struct inode *);
 off_t inode_read_at(struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at(struct inode *, const void *, off_t size, off_t offset);
+bool inode_grow(struct inode *, off_t length);
+size_t inode_write_credits(const struct inode *, off_t size, off_t offset);
+off_t inode_readahead(struct inode *, off_t pos, off_t requested);
 void inode_deny_write(struct inode *);
 void inode_allow_write(struct inode *);
 off_t inode_length(const struct inode *);
 void inode_flush(struct inode *);
+void inode_flush_all(void);
+void inode_release_deferred(void);
+bool inode_is_dirty(const struct inode *);
+bool inode_defrag(struct inode *, size_t *before, size_t *after);
 bool is_dir(struct inode *);
+bool inode_is_indexed(const struct inode *);
+void inode_set_indexed(struct inode *);
+void inode_dir_acquire(struct inode *, bool write);
+void inode_dir_release(struct inode *, bool write);
 disk_sector_t get_dir_sector(struct dir *);
 bool is_good_inode(struct inode *);
 bool is_root_dir(struct dir *);
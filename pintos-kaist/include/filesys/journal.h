@@ -0,0 +1,53 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Number of sectors reserved for the log at format time
+ * (one header sector followed by the log blocks). */
+#define JOURNAL_SECTORS 125
+
+/* Maximum number of log blocks: as many home sectors as fit in the header. */
+#define JOURNAL_MAX 124
+
+/* journal_slot_home() value for a log block that must not be written back. */
+#define JOURNAL_DEAD ((disk_sector_t) -1)
+
+/* Mounting and formatting. */
+void journal_init(void);
+void journal_open(disk_sector_t start, size_t sectors);
+void journal_format(disk_sector_t start, size_t sectors);
+bool journal_enabled(void);
+
+/* Grouping one operation's metadata updates into the running transaction.
+ * An operation reserves CREDITS log blocks, an upper bound on the metadata
+ * sectors it newly dirties, so a transaction never outgrows the log. */
+bool journal_begin(size_t credits);
+bool journal_extend(size_t credits);
+void journal_end(void);
+bool journal_in_op(void);
+void journal_charge(disk_sector_t sector);
+void journal_quiesce(void);
+void journal_resume(void);
+
+/* Crash-recovery testing (kernel option -crash-on-sync): once armed before
+ * the test runs, the first non-empty commit powers the machine off. */
+extern bool journal_crash_on_sync;
+void journal_arm_crash(void);
+
+/* Used by the buffer cache with buffer_cache_lock held. */
+disk_sector_t journal_locate(disk_sector_t sector);
+disk_sector_t journal_log(disk_sector_t sector, const void *data);
+void journal_forget(disk_sector_t sector);
+size_t journal_slot_count(void);
+disk_sector_t journal_slot_home(size_t slot);
+disk_sector_t journal_slot_sector(size_t slot);
+void journal_reset(void);
+
+/* Used by the committing thread, which drops buffer_cache_lock for the I/O. */
+void journal_commit(void);
+void journal_clear(void);
+
+#endif /* filesys/journal.h */
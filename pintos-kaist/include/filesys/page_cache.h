@@ -1,12 +1,33 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include "devices/disk.h"
+#include "filesys/off_t.h"
 
 struct page;
 enum vm_type;
 
 struct page_cache {};
 
+/* 버퍼 캐시가 보유하는 섹터 슬롯 수. */
+#define BUFFER_CACHE_SIZE 64
+
+/* 순차 읽기 시 앞서 읽어 둘 섹터 수. */
+#define READAHEAD_SECTORS 8
+
 void page_cache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+
+/* 섹터 단위 write-back 버퍼 캐시. */
+void buffer_cache_init (void);
+void buffer_cache_done (void);
+void buffer_cache_read (disk_sector_t sector, void *buffer);
+void buffer_cache_write (disk_sector_t sector, const void *buffer);
+void buffer_cache_read_at (disk_sector_t sector, void *buffer, off_t size, off_t ofs);
+void buffer_cache_write_at (disk_sector_t sector, const void *buffer, off_t size, off_t ofs);
+void buffer_cache_write_meta (disk_sector_t sector, const void *buffer);
+void buffer_cache_write_meta_at (disk_sector_t sector, const void *buffer, off_t size, off_t ofs);
+void buffer_cache_read_multi (disk_sector_t sector, size_t cnt, void *buffer);
+void buffer_cache_flush (void);
+bool buffer_cache_flush_data (void);
+void buffer_cache_readahead (disk_sector_t sector);
 #endif
@@ -36,6 +36,11 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_GETDENTS,               /* Reads several directory entries at once. */
+	SYS_FSYNC,                  /* Flushes a file's data and metadata to disk. */
+	SYS_FDATASYNC,              /* Flushes a file's data to disk. */
+	SYS_SYNC,                   /* Flushes the whole file system to disk. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -16,6 +16,13 @@ typedef int off_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* Directory record written by getdents(). */
+struct dirent {
+	int inumber;                      /* Inode number, as from inumber(). */
+	bool isdir;                       /* True if the entry is a directory. */
+	char name[READDIR_MAX_LEN + 1];   /* Null-terminated file name. */
+};
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -48,6 +55,10 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt);
+bool fsync (int fd);
+bool fdatasync (int fd);
+void sync (void);
 int symlink (const char* target, const char* linkpath);
 
 static inline void* get_phys_addr (void *user_addr) {
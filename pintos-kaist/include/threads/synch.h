@@ -38,6 +38,24 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers or a single writer may hold it.
+   Waiting writers block new readers so that writers do not starve. */
+struct rwlock {
+	struct lock lock;           /* Protects the fields below. */
+	struct condition readers_ok; /* Signaled when readers may enter. */
+	struct condition writer_ok; /* Signaled when a writer may enter. */
+	int readers;                /* Number of readers holding the lock. */
+	int waiting_writers;        /* Number of writers waiting. */
+	bool writer;                /* True if a writer holds the lock. */
+};
+
+void rw_init (struct rwlock *);
+void rw_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -135,6 +135,8 @@ struct thread
 
 	/* project4 filesys */
 	struct dir *cwd;
+	int journal_depth; /* journal_begin() 중첩 깊이. */
+	size_t journal_credits; /* 현재 연산이 예약해 두고 아직 쓰지 않은 로그 블록 수. */
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
@@ -11,6 +11,4 @@ void process_exit(void);
 void process_activate(struct thread *next);
 bool lazy_load_segment(struct page *page, void *aux);
 
-struct lock filesys_lock;
-
 #endif /* userprog/process.h */
@@ -271,6 +271,26 @@ int inumber(int fd)
 	return syscall1(SYS_INUMBER, fd);
 }
 
+int getdents(int fd, struct dirent *entries, unsigned cnt)
+{
+	return syscall3(SYS_GETDENTS, fd, entries, cnt);
+}
+
+bool fsync(int fd)
+{
+	return syscall1(SYS_FSYNC, fd);
+}
+
+bool fdatasync(int fd)
+{
+	return syscall1(SYS_FDATASYNC, fd);
+}
+
+void sync(void)
+{
+	syscall0(SYS_SYNC);
+}
+
 int symlink(const char *target, const char *linkpath)
 {
 	return syscall2(SYS_SYMLINK, target, linkpath);
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'a' => {'f0' => [''], 'f1' => [''], 'f2' => [''],
+			'f3' => [''], 'f4' => [''], 'sub' => {}}});
+pass;
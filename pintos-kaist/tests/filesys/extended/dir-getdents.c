@@ -0,0 +1,66 @@
+/* Reads a directory with getdents() and checks that every entry
+   is returned exactly once, with the right type and inode
+   number, and that "." and ".." are not returned. */
+
+#include <string.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 5
+
+static const char *names[FILE_CNT + 1] = {"f0", "f1", "f2", "f3", "f4", "sub"};
+
+void
+test_main (void) 
+{
+  struct dirent ents[16];
+  bool seen[FILE_CNT + 1];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      char file_name[16];
+      snprintf (file_name, sizeof file_name, "a/%s", names[i]);
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+    }
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK ((cnt = getdents (fd, ents, 16)) == FILE_CNT + 1,
+         "getdents \"a\" returns %d entries", FILE_CNT + 1);
+
+  memset (seen, 0, sizeof seen);
+  for (i = 0; i < cnt; i++) 
+    {
+      char path[sizeof "a/" + sizeof ents[0].name];
+      int j, efd;
+
+      for (j = 0; j <= FILE_CNT; j++)
+        if (!strcmp (ents[i].name, names[j]))
+          break;
+      if (j > FILE_CNT)
+        fail ("unexpected entry \"%s\"", ents[i].name);
+      if (seen[j])
+        fail ("entry \"%s\" returned twice", ents[i].name);
+      seen[j] = true;
+
+      if (ents[i].isdir != (j == FILE_CNT))
+        fail ("entry \"%s\" has the wrong type", ents[i].name);
+
+      snprintf (path, sizeof path, "a/%s", ents[i].name);
+      efd = open (path);
+      if (efd < 2)
+        fail ("open \"%s\" failed", path);
+      if (inumber (efd) != ents[i].inumber)
+        fail ("entry \"%s\" has the wrong inode number", ents[i].name);
+      close (efd);
+    }
+  msg ("checked entries of \"a\"");
+
+  CHECK (getdents (fd, ents, 16) == 0, "getdents \"a\" at end returns 0");
+  msg ("close \"a\"");
+  close (fd);
+}
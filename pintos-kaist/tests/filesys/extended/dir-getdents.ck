@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) create "a/f0"
+(dir-getdents) create "a/f1"
+(dir-getdents) create "a/f2"
+(dir-getdents) create "a/f3"
+(dir-getdents) create "a/f4"
+(dir-getdents) mkdir "a/sub"
+(dir-getdents) open "a"
+(dir-getdents) getdents "a" returns 6 entries
+(dir-getdents) checked entries of "a"
+(dir-getdents) getdents "a" at end returns 0
+(dir-getdents) close "a"
+(dir-getdents) end
+EOF
+pass;
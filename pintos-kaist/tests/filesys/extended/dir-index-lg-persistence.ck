@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($big);
+$big->{"file" . ($_ * 2 + 1)} = [''] foreach 0...99;
+check_archive ({"big" => $big});
+pass;
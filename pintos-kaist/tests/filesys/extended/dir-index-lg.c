@@ -0,0 +1,77 @@
+/* Creates 200 files in one directory, which is enough to turn it
+   into an indexed directory and split its buckets, then removes
+   every other file and checks lookups and the entry count. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+static void
+file_name (char *name, size_t size, int i) 
+{
+  snprintf (name, size, "big/file%d", i);
+}
+
+void
+test_main (void) 
+{
+  char name[32];
+  struct dirent ents[16];
+  int fd, cnt, n, i;
+
+  CHECK (mkdir ("big"), "mkdir \"big\"");
+
+  msg ("creating big/file0 through big/file%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      file_name (name, sizeof name, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("opening big/file0 through big/file%d...", FILE_CNT - 1);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      file_name (name, sizeof name, i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+
+  msg ("removing even-numbered files...");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2) 
+    {
+      file_name (name, sizeof name, i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+
+  msg ("checking lookups after removal...");
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      file_name (name, sizeof name, i);
+      fd = open (name);
+      if (i % 2 == 0 && fd != -1)
+        fail ("removed file \"%s\" can still be opened", name);
+      if (i % 2 == 1 && fd < 2)
+        fail ("open \"%s\" failed", name);
+      if (fd > 1)
+        close (fd);
+    }
+  quiet = false;
+
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  cnt = 0;
+  while ((n = getdents (fd, ents, 16)) > 0)
+    cnt += n;
+  CHECK (cnt == FILE_CNT / 2, "\"big\" has %d entries", FILE_CNT / 2);
+  msg ("close \"big\"");
+  close (fd);
+}
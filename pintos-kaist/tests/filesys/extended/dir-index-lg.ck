@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-index-lg) begin
+(dir-index-lg) mkdir "big"
+(dir-index-lg) creating big/file0 through big/file199...
+(dir-index-lg) opening big/file0 through big/file199...
+(dir-index-lg) removing even-numbered files...
+(dir-index-lg) checking lookups after removal...
+(dir-index-lg) open "big"
+(dir-index-lg) "big" has 100 entries
+(dir-index-lg) close "big"
+(dir-index-lg) end
+EOF
+pass;
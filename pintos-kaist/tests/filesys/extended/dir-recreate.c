@@ -0,0 +1,49 @@
+/* Looks up names, removes and re-creates them (as a file and as
+   a directory), and checks that each lookup sees the current
+   entry rather than a stale one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (open ("y") == -1, "open \"y\" (must return -1)");
+  CHECK (create ("y", 0), "create \"y\"");
+  CHECK ((fd = open ("y")) > 1, "open \"y\"");
+  msg ("close \"y\"");
+  close (fd);
+
+  CHECK (create ("x", 0), "create \"x\"");
+  CHECK ((fd = open ("x")) > 1, "open \"x\"");
+  msg ("close \"x\"");
+  close (fd);
+  CHECK (remove ("x"), "remove \"x\"");
+  CHECK (open ("x") == -1, "open \"x\" (must return -1)");
+
+  CHECK (create ("x", 0), "create \"x\"");
+  CHECK ((fd = open ("x")) > 1, "open \"x\"");
+  CHECK (!isdir (fd), "isdir \"x\" (must return false)");
+  msg ("close \"x\"");
+  close (fd);
+  CHECK (remove ("x"), "remove \"x\"");
+
+  CHECK (mkdir ("x"), "mkdir \"x\"");
+  CHECK ((fd = open ("x")) > 1, "open \"x\"");
+  CHECK (isdir (fd), "isdir \"x\"");
+  msg ("close \"x\"");
+  close (fd);
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/f", 0), "create \"d/f\"");
+  CHECK ((fd = open ("d/f")) > 1, "open \"d/f\"");
+  msg ("close \"d/f\"");
+  close (fd);
+  CHECK (remove ("d/f"), "remove \"d/f\"");
+  CHECK (remove ("d"), "remove \"d\"");
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (open ("d/f") == -1, "open \"d/f\" (must return -1)");
+}
@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-recreate) begin
+(dir-recreate) open "y" (must return -1)
+(dir-recreate) create "y"
+(dir-recreate) open "y"
+(dir-recreate) close "y"
+(dir-recreate) create "x"
+(dir-recreate) open "x"
+(dir-recreate) close "x"
+(dir-recreate) remove "x"
+(dir-recreate) open "x" (must return -1)
+(dir-recreate) create "x"
+(dir-recreate) open "x"
+(dir-recreate) isdir "x" (must return false)
+(dir-recreate) close "x"
+(dir-recreate) remove "x"
+(dir-recreate) mkdir "x"
+(dir-recreate) open "x"
+(dir-recreate) isdir "x"
+(dir-recreate) close "x"
+(dir-recreate) mkdir "d"
+(dir-recreate) create "d/f"
+(dir-recreate) open "d/f"
+(dir-recreate) close "d/f"
+(dir-recreate) remove "d/f"
+(dir-recreate) remove "d"
+(dir-recreate) mkdir "d"
+(dir-recreate) open "d/f" (must return -1)
+(dir-recreate) end
+EOF
+pass;
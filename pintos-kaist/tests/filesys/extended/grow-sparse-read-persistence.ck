@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"testfile" => ["\0" x 50000 . random_bytes (1000)
+			       . "\0" x 19000]});
+pass;
@@ -0,0 +1,36 @@
+/* Creates a file with a large initial size, checks that it reads
+   back as zeros, then writes into the middle of it and checks
+   that the bytes around the write are still zeros. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 70000
+#define DATA_OFS 50000
+#define DATA_SIZE 1000
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "testfile";
+  int fd;
+
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  check_file (file_name, buf, sizeof buf);
+
+  random_init (0);
+  random_bytes (buf + DATA_OFS, DATA_SIZE);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("seek \"%s\"", file_name);
+  seek (fd, DATA_OFS);
+  CHECK (write (fd, buf + DATA_OFS, DATA_SIZE) == DATA_SIZE,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
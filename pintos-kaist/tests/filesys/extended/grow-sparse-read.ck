@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-read) begin
+(grow-sparse-read) create "testfile"
+(grow-sparse-read) open "testfile" for verification
+(grow-sparse-read) verified contents of "testfile"
+(grow-sparse-read) close "testfile"
+(grow-sparse-read) open "testfile"
+(grow-sparse-read) seek "testfile"
+(grow-sparse-read) write "testfile"
+(grow-sparse-read) close "testfile"
+(grow-sparse-read) open "testfile" for verification
+(grow-sparse-read) verified contents of "testfile"
+(grow-sparse-read) close "testfile"
+(grow-sparse-read) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Writes a file in three pieces, forcing each piece out with
+   fsync(), fdatasync(), and sync() in turn, then checks the
+   contents.  The persistence check verifies that all three
+   pieces reached the disk. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PIECE 2000
+
+static char buf[PIECE * 3];
+
+void
+test_main (void) 
+{
+  const char *file_name = "data";
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  CHECK (write (fd, buf, PIECE) == PIECE, "write \"%s\" piece 0", file_name);
+  CHECK (fsync (fd), "fsync \"%s\"", file_name);
+  CHECK (write (fd, buf + PIECE, PIECE) == PIECE,
+         "write \"%s\" piece 1", file_name);
+  CHECK (fdatasync (fd), "fdatasync \"%s\"", file_name);
+  CHECK (write (fd, buf + PIECE * 2, PIECE) == PIECE,
+         "write \"%s\" piece 2", file_name);
+  msg ("sync");
+  sync ();
+
+  CHECK (!fsync (STDOUT_FILENO), "fsync stdout (must return false)");
+  CHECK (!fdatasync (1234), "fdatasync bad fd (must return false)");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
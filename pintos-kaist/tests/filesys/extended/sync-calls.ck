@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sync-calls) begin
+(sync-calls) create "data"
+(sync-calls) open "data"
+(sync-calls) write "data" piece 0
+(sync-calls) fsync "data"
+(sync-calls) write "data" piece 1
+(sync-calls) fdatasync "data"
+(sync-calls) write "data" piece 2
+(sync-calls) sync
+(sync-calls) fsync stdout (must return false)
+(sync-calls) fdatasync bad fd (must return false)
+(sync-calls) close "data"
+(sync-calls) open "data" for verification
+(sync-calls) verified contents of "data"
+(sync-calls) close "data"
+(sync-calls) end
+EOF
+pass;
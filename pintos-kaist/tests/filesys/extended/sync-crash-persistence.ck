@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"committed" => [random_bytes (3000)],
+		"dir" => {"inner" => ['']},
+		"last" => ['']});
+pass;
@@ -0,0 +1,37 @@
+/* Creates a file and a directory, then calls sync().  The test
+   kernel runs with -crash-on-sync, so it powers off right after
+   the first non-empty journal commit and before the metadata is
+   written in place.  The file system is not flushed in the
+   background then, and the test creates one more file right
+   before sync() so the commit always has something to log.  The
+   persistence check verifies that mounting the file system again
+   replays the committed transaction. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("committed", 0), "create \"committed\"");
+  CHECK ((fd = open ("committed")) > 1, "open \"committed\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"committed\"");
+  msg ("close \"committed\"");
+  close (fd);
+  CHECK (mkdir ("dir"), "mkdir \"dir\"");
+  CHECK (create ("dir/inner", 0), "create \"dir/inner\"");
+  CHECK (create ("last", 0), "create \"last\"");
+
+  msg ("sync");
+  sync ();
+  fail ("sync returned, but the kernel should have powered off");
+}
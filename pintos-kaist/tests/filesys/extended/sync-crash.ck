@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing 'sync' message\n"
+  if !grep ($_ eq '(sync-crash) sync', @output);
+fail "found 'end' message--sync didn't power off\n"
+  if grep ($_ eq '(sync-crash) end', @output);
+pass;
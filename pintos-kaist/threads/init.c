@@ -36,6 +36,8 @@
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/fat.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -227,6 +229,22 @@ parse_options(char **argv)
 #ifdef FILESYS
 		else if (!strcmp(name, "-f"))
 			format_filesys = true;
+		else if (!strcmp(name, "-dma"))
+			disk_use_dma = true;
+#ifdef EFILESYS
+		else if (!strcmp(name, "-cs"))
+		{
+			fat_format_cluster_sectors = atoi(value);
+			if (fat_format_cluster_sectors < 1 || fat_format_cluster_sectors > MAX_SECTORS_PER_CLUSTER)
+				PANIC("cluster size must be 1 to %d sectors", MAX_SECTORS_PER_CLUSTER);
+		}
+		else if (!strcmp(name, "-extents"))
+			fat_format_features |= FAT_FEATURE_EXTENTS;
+		else if (!strcmp(name, "-fat-prefetch"))
+			fat_prefetch = true;
+		else if (!strcmp(name, "-crash-on-sync"))
+			journal_crash_on_sync = true;
+#endif
 #endif
 		else if (!strcmp(name, "-rs"))
 			random_init(atoi(value));
@@ -252,6 +270,9 @@ run_task(char **argv)
 	const char *task = argv[1];
 
 	printf("Executing '%s':\n", task);
+#ifdef EFILESYS
+	journal_arm_crash();
+#endif
 #ifdef USERPROG
 	if (thread_tests)
 	{
@@ -289,6 +310,7 @@ run_actions(char **argv)
 		{"rm", 2, fsutil_rm},
 		{"put", 2, fsutil_put},
 		{"get", 2, fsutil_get},
+		{"defrag", 2, fsutil_defrag},
 #endif
 		{NULL, 0, NULL},
 	};
@@ -334,6 +356,7 @@ usage(void)
 		   "  ls                 List files in the root directory.\n"
 		   "  cat FILE           Print FILE to the console.\n"
 		   "  rm FILE            Delete FILE.\n"
+		   "  defrag FILE        Move FILE's clusters into one contiguous run.\n"
 		   "Use these actions indirectly via `pintos' -g and -p options:\n"
 		   "  put FILE           Put FILE into file system from scratch disk.\n"
 		   "  get FILE           Get FILE from file system into scratch disk.\n"
@@ -342,6 +365,13 @@ usage(void)
 		   "  -h                 Print this help message and power off.\n"
 		   "  -q                 Power off VM after actions or on panic.\n"
 		   "  -f                 Format file system disk during startup.\n"
+		   "  -dma               Use bus-master IDE DMA for disk transfers.\n"
+#ifdef EFILESYS
+		   "  -cs=SECTORS        Use SECTORS (1-64) sectors per cluster when formatting.\n"
+		   "  -extents           Store inode data as extent lists when formatting.\n"
+		   "  -fat-prefetch      Read the FAT in the background after mounting.\n"
+		   "  -crash-on-sync     Power off without checkpointing after the test's first commit.\n"
+#endif
 		   "  -rs=SEED           Set random number seed to SEED.\n"
 		   "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
@@ -358,7 +388,13 @@ void power_off(void)
 #ifdef FILESYS
 	filesys_done();
 #endif
+	power_off_unclean();
+}
 
+/* 파일 시스템을 정리하지 않고 전원을 끈다. 캐시에 남은 내용은 디스크에 쓰이지 않으므로
+ * 전원이 갑자기 나간 상황과 같다. */
+void power_off_unclean(void)
+{
 	print_stats();
 
 	printf("Powering off...\n");
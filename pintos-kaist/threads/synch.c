@@ -448,3 +448,73 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 	while (!list_empty(&cond->waiters))
 		cond_signal(cond, lock);
 }
+
+/* Initializes RW as a readers-writer lock that nobody holds. */
+void rw_init(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_init(&rw->lock);
+	cond_init(&rw->readers_ok);
+	cond_init(&rw->writer_ok);
+	rw->readers = 0;
+	rw->waiting_writers = 0;
+	rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void rw_read_acquire(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->lock);
+	while (rw->writer || rw->waiting_writers > 0)
+		cond_wait(&rw->readers_ok, &rw->lock);
+	rw->readers++;
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void rw_read_release(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal(&rw->writer_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void rw_write_acquire(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->lock);
+	rw->waiting_writers++;
+	while (rw->writer || rw->readers > 0)
+		cond_wait(&rw->writer_ok, &rw->lock);
+	rw->waiting_writers--;
+	rw->writer = true;
+	lock_release(&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void rw_write_release(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_acquire(&rw->lock);
+	ASSERT(rw->writer);
+	rw->writer = false;
+	if (rw->waiting_writers > 0)
+		cond_signal(&rw->writer_ok, &rw->lock);
+	else
+		cond_broadcast(&rw->readers_ok, &rw->lock);
+	lock_release(&rw->lock);
+}
@@ -1,4 +1,5 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
@@ -17,6 +18,7 @@
 #include "filesys/directory.h"
 #include "filesys/fat.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "vm/vm.h"
 
 #define MAX_PATH 128
@@ -44,6 +46,9 @@ bool sys_mkdir(const char *dir);
 bool sys_readdir(int fd, char *name);
 bool sys_isdir(int fd);
 int sys_inumber(int fd);
+int sys_getdents(int fd, struct dirent *entries, unsigned cnt);
+bool sys_fsync(int fd, bool data_only);
+void sys_sync(void);
 
 /* 시스템 콜.
  *
@@ -73,8 +78,6 @@ void syscall_init(void)
  */
 	write_msr(MSR_SYSCALL_MASK,
 			  FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-
-	lock_init(&filesys_lock);
 }
 
 /* The main system call interface */
@@ -160,6 +163,18 @@ void syscall_handler(struct intr_frame *f UNUSED)
 	case SYS_INUMBER:
 		f->R.rax = sys_inumber(arg1);
 		break;
+	case SYS_GETDENTS:
+		f->R.rax = sys_getdents(arg1, (struct dirent *)arg2, arg3);
+		break;
+	case SYS_FSYNC:
+		f->R.rax = sys_fsync(arg1, false);
+		break;
+	case SYS_FDATASYNC:
+		f->R.rax = sys_fsync(arg1, true);
+		break;
+	case SYS_SYNC:
+		sys_sync();
+		break;
 	default:
 		thread_exit();
 		break;
@@ -371,14 +386,11 @@ static int sys_write(int fd, const void *buffer, unsigned size)
 	if (f == NULL)
 		return -1;
 
-	lock_acquire(&filesys_lock);
 	if (is_file_dir(f))
 	{
-		lock_release(&filesys_lock);
 		sys_exit(-1);
 	}
 	int bytes_written = file_write(f, buffer, size);
-	lock_release(&filesys_lock);
 	return bytes_written;
 }
 
@@ -394,7 +406,6 @@ void sys_exit(int status)
 bool sys_create(const char *file, unsigned initial_size)
 {
 
-	lock_acquire(&filesys_lock);
 	check_address(file);
 	if (file == NULL || strcmp(file, "") == 0)
 	{
@@ -402,16 +413,13 @@ bool sys_create(const char *file, unsigned initial_size)
 	}
 
 	bool success = filesys_create(file, initial_size);
-	lock_release(&filesys_lock);
 	return success;
 }
 
 bool sys_remove(const char *file)
 {
 	check_address(file);
-	lock_acquire(&filesys_lock);
 	bool success = filesys_remove(file);
-	lock_release(&filesys_lock);
 	return success;
 }
 
@@ -474,9 +482,7 @@ int sys_read(int fd, void *buffer, unsigned size)
 	}
 
 	// 파일 읽기
-	lock_acquire(&filesys_lock);
 	int bytes_read = file_read(file_obj, buffer, size);
-	lock_release(&filesys_lock);
 	return bytes_read;
 }
 
@@ -502,12 +508,10 @@ int sys_open(const char *file)
 	{
 		return -1;
 	}
-	lock_acquire(&filesys_lock);
 	struct file *file_obj = filesys_open(file);
 
 	if (file_obj == NULL)
 	{
-		lock_release(&filesys_lock);
 		return -1;
 	}
 
@@ -519,7 +523,6 @@ int sys_open(const char *file)
 	}
 
 	int fd = find_unused_fd(file_obj);
-	lock_release(&filesys_lock);
 	return fd;
 }
 
@@ -627,9 +630,7 @@ int sys_dup2(int oldfd, int newfd)
 	/* newfd가 이미 열려 있는 경우, 조용히 닫은 후에 oldfd를 복제합니다. */
 	if (cur->fd_table[newfd] != NULL)
 	{
-		lock_acquire(&filesys_lock);
 		sys_close(newfd);
-		lock_release(&filesys_lock);
 	}
 	cur->fd_table[newfd] = cur->fd_table[oldfd];
 
@@ -661,29 +662,39 @@ bool sys_mkdir(const char *dir)
 		cur_dir = dir_open(inode);
 	}
 
-	disk_sector_t sector = cluster_to_sector(fat_create_chain(0));
-	if (!dir_create(sector, 16))
+	/* 클러스터 할당부터 ., .. 추가까지 한 트랜잭션으로 묶는다. */
+	if (!journal_begin(1 + INODE_CREATE_CREDITS + DIR_ADD_CREDITS + 2 * DIR_ENTRY_CREDITS))
 		goto fail;
+	/* 새 디렉터리 inode는 부모 디렉터리 근처에 둔다. */
+	cluster_t clst;
+	if (!fat_allocate_near(1, fat_hint(get_dir_sector(cur_dir)), &clst))
+		goto fail_journal;
+	disk_sector_t sector = cluster_to_sector(clst);
+	if (!dir_create(sector, 16))
+		goto fail_journal;
 
 	struct dir *new_dir = dir_open(inode_open(sector));
 	/* 현재 디렉토리에 새 디렉토리 추가 */
 	dprintf("dir add before\n");
-	if (!dir_add(cur_dir, path_lst[path_cnt - 1], sector))
-		goto fail;
+	if (!dir_add(cur_dir, path_lst[path_cnt - 1], sector, true))
+		goto fail_journal;
 
 	dprintf("dir add after\n");
 
 	/* 새 디렉토리에 . 추가 */
-	if (!dir_add(new_dir, ".", sector))
-		goto fail;
+	if (!dir_add(new_dir, ".", sector, true))
+		goto fail_journal;
 	/* 새 디렉토리에 .. 추가 */
-	if (!dir_add(new_dir, "..", get_dir_sector(cur_dir)))
-		goto fail;
+	if (!dir_add(new_dir, "..", get_dir_sector(cur_dir), true))
+		goto fail_journal;
+	journal_end();
 
 	dir_close(new_dir);
 	dir_close(cur_dir);
 
 	return true;
+fail_journal:
+	journal_end();
 fail:
 	if (new_dir)
 		dir_close(new_dir);
@@ -767,4 +778,70 @@ bool sys_readdir(int fd, char *name)
 			return true;
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+/* 디렉터리 fd의 현재 위치부터 엔트리를 최대 CNT개 ENTRIES에 채운다.
+ * readdir()와 같이 "."과 ".."은 건너뛰며, 채운 레코드 수를 반환한다.
+ * 끝에 도달했으면 0, fd가 디렉터리가 아니면 -1. */
+int sys_getdents(int fd, struct dirent *entries, unsigned cnt)
+{
+	struct dir_entry batch[16];
+	unsigned filled = 0;
+
+	if (cnt == 0)
+		return 0;
+	if (cnt > INT_MAX / sizeof *entries)
+		return -1;
+	check_write_buffer(entries, cnt * sizeof *entries);
+
+	if (fd < 2 || fd >= MAX_FD)
+		return -1;
+	struct thread *cur = thread_current();
+	struct file *file = cur->fd_table[fd];
+	if (file == NULL || file == STDIN || file == STDOUT || !is_file_dir(file))
+		return -1;
+
+	/* sys_open()은 디렉터리 fd에 struct dir을 넣어 두므로 위치가 호출 사이에 유지된다. */
+	struct dir *dir = (struct dir *)file;
+
+	while (filled < cnt)
+	{
+		size_t want = cnt - filled < 16 ? cnt - filled : 16;
+		size_t n = dir_read_entries(dir, batch, want);
+		if (n == 0)
+			break;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (strcmp(batch[i].name, ".") == 0 || strcmp(batch[i].name, "..") == 0)
+				continue;
+			entries[filled].inumber = batch[i].inode_sector;
+			entries[filled].isdir = batch[i].isdir;
+			strlcpy(entries[filled].name, batch[i].name, sizeof entries[filled].name);
+			filled++;
+		}
+	}
+	return filled;
+}
+
+/* fsync()와 fdatasync(). FD의 데이터(DATA_ONLY가 false면 메타데이터까지)가
+ * 디스크에 기록될 때까지 기다린다. 동시에 부른 호출자들은 한 번의 flush를 공유한다. */
+bool sys_fsync(int fd, bool data_only)
+{
+	if (fd < 2 || fd >= MAX_FD)
+		return false;
+	struct thread *cur = thread_current();
+	struct file *file = cur->fd_table[fd];
+	if (file == NULL || file == STDIN || file == STDOUT)
+		return false;
+
+	/* 디렉터리 fd의 struct dir도 inode를 첫 필드로 가지므로 그대로 쓸 수 있다. */
+	filesys_fsync(file_get_inode(file), data_only);
+	return true;
+}
+
+/* 파일 시스템 전체를 디스크에 기록한다. */
+void sys_sync(void)
+{
+	filesys_sync();
+}
@@ -93,12 +93,8 @@ anon_swap_in(struct page *page, void *kva)
 	// 총 8개의 섹터를 순차적으로 읽어야 전체 페이지 데이터를 복원할 수 있음
 	// swap_idx는 스왑 테이블 상의 페이지 단위 인덱스를 의미하며,
 	// 실제 섹터 번호는 swap_idx * 8부터 시작함
-	for (int i = 0; i < 8; i++)
-	{
-		disk_read(swap_disk,					 // 스왑 디스크에서 데이터를 읽어옴
-				  (swap_idx * 8) + i,			 // 8개의 연속된 섹터에 페이지가 저장되어 있으므로, i를 더해가며 읽음
-				  kva + (DISK_SECTOR_SIZE * i)); // 읽어온 데이터를 커널 가상 주소 kva에 512B 단위로 복사
-	}
+	// 8개의 섹터는 연속되어 있으므로 한 번의 디스크 명령으로 kva에 읽어 들임
+	disk_read_multi(swap_disk, swap_idx * 8, 8, kva);
 
 	// 스왑 테이블에서 해당 스왑 슬롯을 비어있다고 표시 (해당 슬롯 재사용 가능하도록)
 	bitmap_reset(swap_table, swap_idx);
@@ -135,10 +131,7 @@ anon_swap_out(struct page *page)
 	}
 
 	// swap in에 자세히 주석을 달아 놓았음 잘 살펴 보셈
-	for (int i = 0; i < 8; i++)
-	{
-		disk_write(swap_disk, (swap_idx * 8) + i, page->frame->kva + (DISK_SECTOR_SIZE * i));
-	}
+	disk_write_multi(swap_disk, swap_idx * 8, 8, page->frame->kva);
 
 	// 페이지와 프레임 간의 연결을 끊음 (프레임은 더 이상 이 페이지를 참조 하지 않음)
 	page->frame->page = NULL;
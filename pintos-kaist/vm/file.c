@@ -103,20 +103,15 @@ file_backed_swap_out(struct page *page)
 	// dirty bit가 true이면, 즉 메모리에서 수정된 경우
 	if (dirty_bit == true)
 	{
-		// 공유 자원 접근 → 락 걸고 접근
-		lock_acquire(&filesys_lock);
+		// 동기화는 file_write_at 안에서 inode 단위로 이루어진다
 		if (file_write_at(file_page->file,		// mmap된 파일 객체
 						  page->frame->kva,		// 페이지의 실제 물리 주소
 						  file_page->read_byte, // 실제로 파일에 기록할 바이트 수
 						  file_page->offset)	// 파일 내 시작 위치
 			!= (off_t)file_page->read_byte)
 		{
-			// write 실패하면 lock 해제 해야겠지?
-			lock_release(&filesys_lock);
 			return false;
 		}
-		// 파일 쓰기 완료 후 락 해제
-		lock_release(&filesys_lock);
 
 		// 더티 비트 클리어(쓰기 완!)
 		pml4_set_dirty(curr->pml4, page->va, false);
@@ -147,12 +142,10 @@ file_backed_destroy(struct page *page)
 	// 페이지가 dirty 상태 → 메모리 상에서 파일 내용이 수정됨
 	if (pml4_is_dirty(thread_current()->pml4, page->va))
 	{
-		lock_acquire(&filesys_lock);
 		off_t written = file_write_at(file_page->file,		// mmap으로 매핑된 파일 객체
 									  page->frame->kva,		// 물리 메모리 상 해당 페이지의 커널 주소
 									  file_page->read_byte, // 실제로 파일에 쓸 바이트 수
 									  file_page->offset);	// mmap할 때 저장된 파일 내부의 오프셋 위치
-		lock_release(&filesys_lock);
 		ASSERT(written == file_page->read_byte);
 
 		// dirty bit를 false로 초기화(더 이상 수정 X)